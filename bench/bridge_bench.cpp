@@ -0,0 +1,231 @@
+// 测量正则引擎之外的开销：Qt 与 Rust 之间的字符串转换、cxx 类型构造、输入的编码检查以及表格模型的填充。
+//
+// 用法：bridge-bench [--iters N] [--json PATH]
+//
+// 每个阶段单独计时，输入大小和匹配数量各取几档，输出每个阶段耗时的中位数。
+
+#include <QApplication>
+#include <QFile>
+#include <QPlainTextEdit>
+#include <QStandardItemModel>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "cppbridge.rs.h"
+
+namespace
+{
+    // 只为计时而算出的结果写入这里，编译器不能把计算优化掉，之后再读出来检查
+    volatile size_t sink;
+
+    // 与引擎基准测试一样使用固定种子，每次运行的输入完全相同
+    struct Rng
+    {
+        uint64_t state;
+
+        uint64_t next()
+        {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 0x2545F4914F6CDD1DULL;
+        }
+
+        size_t below(size_t n)
+        {
+            return next() % n;
+        }
+    };
+
+    QString makeInput(size_t size)
+    {
+        Rng rng{0x1234'5678};
+        const char *levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+        const char *words[] = {"request", "user", "item", "cache", "正则", "匹配", "引擎"};
+        std::string text;
+        text.reserve(size + 256);
+        char line[256];
+        while (text.size() < size)
+        {
+            snprintf(line, sizeof(line), "2023-10-%02zu %s [worker-%zu] id=%zu %s took=%zums\n",
+                     rng.below(28) + 1, levels[rng.below(6)], rng.below(16), rng.below(100000),
+                     words[rng.below(7)], rng.below(2000));
+            text += line;
+        }
+        return QString::fromUtf8(text.data(), text.size());
+    }
+
+    double medianMs(int iters, const std::function<void()> &f)
+    {
+        std::vector<double> times;
+        for (int i = 0; i < std::max(iters, 1); i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            f();
+            auto end = std::chrono::steady_clock::now();
+            times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+
+    RegexOptions defaultOptions()
+    {
+        RegexOptions options;
+        options.ignore_whitespace = false;
+        options.case_insensitive = false;
+        options.multi_line = false;
+        options.dot_matches_new_line = false;
+        options.unicode = true;
+        options.crlf = false;
+        options.line_terminator = '\n';
+        options.swap_greed = false;
+        options.nest_limit = 0;
+        options.profile = false;
+        options.dfa_size_limit = 0;
+        return options;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // 只需要文本控件的排版，不需要显示窗口
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+
+    int iters = 5;
+    QString json_path;
+    auto args = app.arguments();
+    for (int i = 1; i + 1 < args.size(); i += 2)
+    {
+        if (args[i] == "--iters")
+        {
+            iters = args[i + 1].toInt();
+        }
+        else if (args[i] == "--json")
+        {
+            json_path = args[i + 1];
+        }
+    }
+
+    // 分别对应很少、中等和很多的匹配
+    const std::pair<const char *, const char *> patterns[] = {
+        {"rare", "ERROR"},
+        {"medium", R"(id=(\d+))"},
+        {"dense", R"(\w+)"},
+    };
+    const size_t sizes[] = {1 << 20, 8 << 20};
+
+    QStringList records;
+    printf("%-8s %-8s %10s %10s %12s %12s %12s %12s %12s %12s %12s\n", "size", "pattern", "matches",
+           "toPlain", "toUtf8", "Str(ptr)", "Str(ptr,n)", "Haystack", "engine", "fromUtf8", "items");
+    for (auto size : sizes)
+    {
+        auto input = makeInput(size);
+        QPlainTextEdit edit;
+        edit.setPlainText(input);
+
+        for (auto &&[name, pattern] : patterns)
+        {
+            auto re = regex_new(pattern, defaultOptions());
+
+            QString plain;
+            auto to_plain = medianMs(iters, [&]()
+                                     { plain = edit.toPlainText(); });
+            QByteArray utf8;
+            auto to_utf8 = medianMs(iters, [&]()
+                                    { utf8 = plain.toUtf8(); });
+            // 只传指针时 cxx 需要先 strlen，再检查 UTF-8
+            auto str_ptr = medianMs(iters, [&]()
+                                    { sink = rust::Str(utf8.data()).size(); });
+            // 输入中没有 NUL，strlen 得到的长度应当与按长度构造的相同
+            auto ptr_size = sink;
+            auto str_len = medianMs(iters, [&]()
+                                    { sink = rust::Str(utf8.data(), utf8.size()).size(); });
+            if (ptr_size != sink)
+            {
+                fprintf(stderr, "rust::Str length mismatch: %zu != %zu\n", ptr_size, static_cast<size_t>(sink));
+                return 1;
+            }
+
+            // 界面在输入变化后只做一次这一步
+            std::optional<rust::Box<Haystack>> haystack;
+            auto to_haystack = medianMs(iters, [&]()
+                                        { haystack = haystack_new(rust::Slice<const uint8_t>(reinterpret_cast<const uint8_t *>(utf8.data()), utf8.size())); });
+
+            std::optional<CaptureColumns> columns;
+            auto engine = medianMs(iters, [&]()
+                                   { columns = regex_match_columns(re, haystack.value(), 0, 0); });
+            auto &result = columns.value();
+
+            std::vector<QString> texts;
+            auto from_utf8 = medianMs(iters, [&]()
+                                      {
+                texts.clear();
+                texts.reserve(result.len * result.columns.size());
+                for (size_t m = 0; m < result.len; m++)
+                {
+                    for (auto &&g : result.columns)
+                    {
+                        auto start = g.value_offsets[m];
+                        texts.push_back(QString::fromUtf8(g.values.data() + start, g.value_offsets[m + 1] - start));
+                    }
+                } });
+
+            auto items = medianMs(iters, [&]()
+                                  {
+                QStandardItemModel model;
+                model.setColumnCount(result.columns.size());
+                size_t i = 0;
+                for (size_t m = 0; m < result.len; m++)
+                {
+                    QList<QStandardItem *> row;
+                    for (size_t g = 0; g < result.columns.size(); g++)
+                    {
+                        auto item = new QStandardItem(texts[i++]);
+                        item->setData(QPoint(result.columns[g].spans[m * 2], result.columns[g].spans[m * 2 + 1]), Qt::UserRole + 1);
+                        row.append(item);
+                    }
+                    model.appendRow(row);
+                } });
+
+            printf("%-8s %-8s %10zu %10.2f %12.2f %12.2f %12.2f %12.2f %12.2f %12.2f %12.2f\n",
+                   QString("%1MB").arg(size >> 20).toUtf8().data(), name, result.len,
+                   to_plain, to_utf8, str_ptr, str_len, to_haystack, engine, from_utf8, items);
+            records.append(QString("{\"size\":%1,\"pattern\":\"%2\",\"matches\":%3,\"to_plain_text_ms\":%4,\"to_utf8_ms\":%5,\"str_from_ptr_ms\":%6,\"str_from_ptr_len_ms\":%7,\"haystack_ms\":%8,\"engine_ms\":%9,\"from_utf8_ms\":%10,\"items_ms\":%11}")
+                               .arg(size)
+                               .arg(name)
+                               .arg(result.len)
+                               .arg(to_plain, 0, 'f', 3)
+                               .arg(to_utf8, 0, 'f', 3)
+                               .arg(str_ptr, 0, 'f', 3)
+                               .arg(str_len, 0, 'f', 3)
+                               .arg(to_haystack, 0, 'f', 3)
+                               .arg(engine, 0, 'f', 3)
+                               .arg(from_utf8, 0, 'f', 3)
+                               .arg(items, 0, 'f', 3));
+        }
+    }
+
+    if (!json_path.isEmpty())
+    {
+        QFile f(json_path);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            fprintf(stderr, "cannot open %s\n", json_path.toUtf8().data());
+            return 1;
+        }
+        f.write(QString("{\"iters\":%1,\"results\":[\n%2\n]}\n").arg(iters).arg(records.join(",\n")).toUtf8());
+    }
+    return 0;
+}
@@ -0,0 +1,10 @@
+//! 引擎吞吐量基准测试，参数见 src/bench.rs
+//!
+//! cargo bench --features bench --bench engine -- --size 8 --json result.json
+
+#[global_allocator]
+static ALLOC: regex_engine::bench::CountingAlloc = regex_engine::bench::CountingAlloc;
+
+fn main() -> anyhow::Result<()> {
+    regex_engine::bench::main()
+}
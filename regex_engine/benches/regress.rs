@@ -0,0 +1,16 @@
+//! 性能回归检查，参数见 src/regress.rs
+//!
+//! cargo bench --features bench --bench regress -- --baseline baseline.json --save
+//! cargo bench --features bench --bench regress -- --baseline baseline.json --threshold 10
+
+#[global_allocator]
+static ALLOC: regex_engine::bench::CountingAlloc = regex_engine::bench::CountingAlloc;
+
+fn main() -> anyhow::Result<std::process::ExitCode> {
+    let regressions = regex_engine::regress::main()?;
+    Ok(if regressions == 0 {
+        std::process::ExitCode::SUCCESS
+    } else {
+        std::process::ExitCode::FAILURE
+    })
+}
@@ -0,0 +1,420 @@
+//! 引擎吞吐量基准测试，由 `cargo bench --features bench` 运行 benches/engine.rs 调用。
+//!
+//! 语料全部由固定种子的伪随机数生成，每次运行完全相同，不依赖外部文件。
+//! 结果以 JSON 输出，每条结果占一行，方便在不同版本之间 diff。
+//!
+//! 参数：
+//!   --size <MB>     每份语料的大小，默认 4
+//!   --iters <N>     每项测试的重复次数，默认 7
+//!   --filter <S>    只运行名称中包含 S 的测试
+//!   --json <PATH>   把结果写入文件，默认输出到标准输出
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::Instant;
+
+use super::cppbridge::{self, ffi::RegexOptions};
+
+static ALLOCS: AtomicU64 = AtomicU64::new(0);
+static ALLOC_BYTES: AtomicU64 = AtomicU64::new(0);
+
+/// 统计分配次数和字节数的分配器，需要在基准程序中声明为 `#[global_allocator]`
+pub struct CountingAlloc;
+
+unsafe impl GlobalAlloc for CountingAlloc {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCS.fetch_add(1, Ordering::Relaxed);
+        ALLOC_BYTES.fetch_add(layout.size() as u64, Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCS.fetch_add(1, Ordering::Relaxed);
+        ALLOC_BYTES.fetch_add(new_size as u64, Ordering::Relaxed);
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+fn alloc_counts() -> (u64, u64) {
+    (
+        ALLOCS.load(Ordering::Relaxed),
+        ALLOC_BYTES.load(Ordering::Relaxed),
+    )
+}
+
+// xorshift64*，只用来生成语料
+struct Rng(u64);
+
+impl Rng {
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        self.0.wrapping_mul(0x2545F4914F6CDD1D)
+    }
+
+    fn below(&mut self, n: usize) -> usize {
+        (self.next() % n as u64) as usize
+    }
+
+    fn pick<'a>(&mut self, items: &[&'a str]) -> &'a str {
+        items[self.below(items.len())]
+    }
+}
+
+pub struct Corpus {
+    pub name: &'static str,
+    pub text: String,
+}
+
+fn ascii_logs(size: usize) -> String {
+    let mut rng = Rng(0x1234_5678);
+    let levels = ["INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"];
+    let paths = ["/api/v1/items", "/api/v1/users", "/static/app.js", "/login"];
+    let mut text = String::with_capacity(size + 256);
+    while text.len() < size {
+        let t = rng.below(86400);
+        text.push_str(&format!(
+            "2023-10-{:02}T{:02}:{:02}:{:02}Z {} [worker-{}] {} {}/{} status={} took={}ms user={}@example.com\n",
+            rng.below(28) + 1,
+            t / 3600,
+            t / 60 % 60,
+            t % 60,
+            rng.pick(&levels),
+            rng.below(16),
+            rng.pick(&["GET", "POST", "PUT"]),
+            rng.pick(&paths),
+            rng.below(100000),
+            rng.pick(&["200", "200", "200", "404", "500"]),
+            rng.below(2000),
+            rng.pick(&["alice", "bob", "carol", "dave"]),
+        ));
+    }
+    text
+}
+
+fn cjk_text(size: usize) -> String {
+    let mut rng = Rng(0x9abc_def0);
+    let words = "正则 表达式 匹配 引擎 文本 搜索 替换 分割 性能 测试 数据 用户 北京 上海 二〇二三年 东京 日本語 한국어 的 了 是 在"
+        .split(' ')
+        .collect::<Vec<_>>();
+    let mut text = String::with_capacity(size + 64);
+    while text.len() < size {
+        for _ in 0..rng.below(20) + 5 {
+            text.push_str(rng.pick(&words));
+        }
+        text.push_str(&format!("{}。", rng.below(10000)));
+        if rng.below(4) == 0 {
+            text.push('\n');
+        }
+    }
+    text
+}
+
+fn csv_rows(size: usize) -> String {
+    let mut rng = Rng(0x0f0f_0f0f);
+    let names = ["Alice", "Bob", "\"Smith, John\"", "张三", "Zoë"];
+    let mut text = String::from("id,name,email,amount,date\n");
+    let mut id = 0;
+    while text.len() < size {
+        id += 1;
+        text.push_str(&format!(
+            "{},{},user{}@mail.example.org,{}.{:02},2023-{:02}-{:02}\n",
+            id,
+            rng.pick(&names),
+            rng.below(100000),
+            rng.below(100000),
+            rng.below(100),
+            rng.below(12) + 1,
+            rng.below(28) + 1,
+        ));
+    }
+    text
+}
+
+// 长串字母中夹杂极少量数字，配合没有字面量可用的计数重复和大字符类，
+// 前缀过滤器无从下手，懒惰 DFA 会产生大量状态
+fn pathological(size: usize) -> String {
+    let mut rng = Rng(0x5555_aaaa);
+    let mut text = String::with_capacity(size + 8);
+    while text.len() < size {
+        let c = if rng.below(5000) == 0 {
+            '7'
+        } else {
+            (b'a' + rng.below(26) as u8) as char
+        };
+        text.push(c);
+        if rng.below(20000) == 0 {
+            text.push('\n');
+        }
+    }
+    text
+}
+
+pub fn corpora(size: usize) -> Vec<Corpus> {
+    vec![
+        Corpus {
+            name: "ascii_logs",
+            text: ascii_logs(size),
+        },
+        Corpus {
+            name: "cjk",
+            text: cjk_text(size),
+        },
+        Corpus {
+            name: "csv",
+            text: csv_rows(size),
+        },
+        Corpus {
+            name: "pathological",
+            text: pathological(size),
+        },
+    ]
+}
+
+// (语料, 名称, 正则, 替换模板)
+const PATTERNS: &[(&str, &str, &str, &str)] = &[
+    ("ascii_logs", "literal", "ERROR", "E"),
+    ("ascii_logs", "alternation", "WARN|ERROR|DEBUG", "[$0]"),
+    (
+        "ascii_logs",
+        "captures",
+        r"(?P<method>GET|POST|PUT) (?P<path>\S+) status=(?P<status>\d+)",
+        "$status $method",
+    ),
+    ("ascii_logs", "email", r"[\w.]+@[\w.]+\.\w+", "<email>"),
+    ("ascii_logs", "line", r"(?m)^.*status=500.*$", ""),
+    ("cjk", "literal", "引擎", "engine"),
+    ("cjk", "class", r"\p{Han}+", "<$0>"),
+    ("cjk", "numbers", r"\d+。", "#"),
+    ("csv", "field", r"(?m)^(\d+),([^,\n]*),", "$1;$2;"),
+    ("csv", "quoted", r#""[^"]*""#, "''"),
+    ("csv", "date", r"(\d{4})-(\d{2})-(\d{2})", "$3/$2/$1"),
+    ("pathological", "bounded", r"[a-z]{2,20}[0-9]", "#"),
+    ("pathological", "unicode_word", r"\w{20}\W", "#"),
+    (
+        "pathological",
+        "alternation",
+        r"(a|ab|abc|abcd)+[r-z]{3}",
+        "#",
+    ),
+];
+
+pub struct Sample {
+    pub corpus: &'static str,
+    pub pattern: &'static str,
+    pub op: &'static str,
+    pub bytes: u64,
+    pub matches: u64,
+    pub median_ns: u64,
+    pub p95_ns: u64,
+    pub allocs: u64,
+    pub alloc_bytes: u64,
+}
+
+impl Sample {
+    pub fn name(&self) -> String {
+        format!("{}/{}/{}", self.corpus, self.pattern, self.op)
+    }
+
+    fn mb_per_s(&self) -> f64 {
+        self.bytes as f64 / (1 << 20) as f64 / (self.median_ns.max(1) as f64 / 1e9)
+    }
+
+    fn matches_per_s(&self) -> f64 {
+        self.matches as f64 / (self.median_ns.max(1) as f64 / 1e9)
+    }
+
+    pub fn to_json(&self) -> String {
+        format!(
+            "{{\"name\":{},\"bytes\":{},\"matches\":{},\"median_ns\":{},\"p95_ns\":{},\"mb_per_s\":{:.2},\"matches_per_s\":{:.0},\"allocs\":{},\"alloc_bytes\":{}}}",
+            super::trace::json_str(&self.name()),
+            self.bytes,
+            self.matches,
+            self.median_ns,
+            self.p95_ns,
+            self.mb_per_s(),
+            self.matches_per_s(),
+            self.allocs,
+            self.alloc_bytes
+        )
+    }
+}
+
+fn options() -> RegexOptions {
+    RegexOptions {
+        ignore_whitespace: false,
+        case_insensitive: false,
+        multi_line: false,
+        dot_matches_new_line: false,
+        unicode: true,
+        crlf: false,
+        line_terminator: b'\n',
+        swap_greed: false,
+        nest_limit: 0,
+        profile: false,
+        dfa_size_limit: 0,
+    }
+}
+
+/// 重复运行 f，返回耗时的中位数、p95，以及最后一次运行的分配次数、字节数和 f 的返回值
+fn measure(iters: usize, mut f: impl FnMut() -> u64) -> (u64, u64, u64, u64, u64) {
+    let mut times = vec![];
+    let mut result = (0, 0, 0);
+    for _ in 0..iters.max(1) {
+        let (allocs, bytes) = alloc_counts();
+        let now = Instant::now();
+        let n = f();
+        times.push(now.elapsed().as_nanos() as u64);
+        let (allocs2, bytes2) = alloc_counts();
+        result = (n, allocs2 - allocs, bytes2 - bytes);
+    }
+    times.sort_unstable();
+    let median = times[times.len() / 2];
+    let p95 = times[(times.len() * 95).div_ceil(100) - 1];
+    (median, p95, result.0, result.1, result.2)
+}
+
+pub struct Config {
+    pub size: usize,
+    pub iters: usize,
+    pub filter: String,
+}
+
+pub fn run(config: &Config, mut report: impl FnMut(&Sample)) -> anyhow::Result<()> {
+    let corpora = corpora(config.size);
+    for &(corpus, name, pattern, rep) in PATTERNS {
+        let corpus_text = &corpora.iter().find(|c| c.name == corpus).unwrap().text;
+        // 与界面一样只检查一次编码，计时只包含搜索
+        let text = &cppbridge::haystack_new(corpus_text.as_bytes())?;
+        let re = cppbridge::regex_new(pattern, &options())?;
+        let template = cppbridge::template_new(&re, rep)?;
+        let ops: [(&'static str, &dyn Fn() -> anyhow::Result<u64>, u64); 4] = [
+            (
+                "parse",
+                &|| cppbridge::regex_parse(pattern, false).map(|_| 0),
+                pattern.len() as u64,
+            ),
+            (
+                "match",
+                &|| Ok(cppbridge::regex_match(&re, text, 0, 0)?.matches.len() as u64),
+                corpus_text.len() as u64,
+            ),
+            (
+                "replace",
+                &|| Ok(cppbridge::regex_replace(&re, text, &template).spans.len() as u64),
+                corpus_text.len() as u64,
+            ),
+            (
+                "split",
+                &|| Ok(cppbridge::regex_split(&re, text).len().saturating_sub(1) as u64),
+                corpus_text.len() as u64,
+            ),
+        ];
+        for (op, f, bytes) in ops {
+            let full = format!("{}/{}/{}", corpus, name, op);
+            if !full.contains(&config.filter) {
+                continue;
+            }
+            let mut error = None;
+            let (median_ns, p95_ns, matches, allocs, alloc_bytes) =
+                measure(config.iters, || match f() {
+                    Ok(n) => n,
+                    Err(e) => {
+                        error = Some(e);
+                        0
+                    }
+                });
+            if let Some(e) = error {
+                return Err(e);
+            }
+            report(&Sample {
+                corpus,
+                pattern: name,
+                op,
+                bytes,
+                matches,
+                median_ns,
+                p95_ns,
+                allocs,
+                alloc_bytes,
+            });
+        }
+    }
+    Ok(())
+}
+
+pub fn parse_args(args: impl Iterator<Item = String>) -> anyhow::Result<(Config, Option<String>)> {
+    let mut config = Config {
+        size: 4 << 20,
+        iters: 7,
+        filter: String::new(),
+    };
+    let mut json = None;
+    let mut args = args.skip(1);
+    while let Some(arg) = args.next() {
+        let mut value = || {
+            args.next()
+                .ok_or_else(|| anyhow::anyhow!("{} 缺少参数", arg))
+        };
+        match arg.as_str() {
+            "--size" => config.size = value()?.parse::<usize>()? << 20,
+            "--iters" => config.iters = value()?.parse()?,
+            "--filter" => config.filter = value()?,
+            "--json" => json = Some(value()?),
+            // cargo bench 会附加 --bench
+            "--bench" => {}
+            _ => anyhow::bail!("未知参数 {}", arg),
+        }
+    }
+    Ok((config, json))
+}
+
+/// 打印表头，之后每条结果用 print_sample 打印一行
+pub fn print_header() {
+    eprintln!(
+        "{:<40} {:>10} {:>12} {:>14} {:>10}",
+        "测试", "MB/s", "匹配/秒", "分配次数", "中位数 ms"
+    );
+}
+
+pub fn print_sample(s: &Sample) {
+    eprintln!(
+        "{:<40} {:>10.1} {:>12.0} {:>14} {:>10.3}",
+        s.name(),
+        s.mb_per_s(),
+        s.matches_per_s(),
+        s.allocs,
+        s.median_ns as f64 / 1e6
+    );
+}
+
+/// 把 Sample::to_json 的结果拼成完整的 JSON 文档
+pub fn document(config: &Config, lines: &[String]) -> String {
+    format!(
+        "{{\"version\":1,\"size\":{},\"iters\":{},\"results\":[\n{}\n]}}\n",
+        config.size,
+        config.iters,
+        lines.join(",\n")
+    )
+}
+
+pub fn main() -> anyhow::Result<()> {
+    let (config, json) = parse_args(std::env::args())?;
+    let mut lines = vec![];
+    print_header();
+    run(&config, |s| {
+        print_sample(s);
+        lines.push(s.to_json());
+    })?;
+    let output = document(&config, &lines);
+    match json {
+        Some(path) => std::fs::write(path, output)?,
+        None => print!("{}", output),
+    }
+    Ok(())
+}
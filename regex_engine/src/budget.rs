@@ -0,0 +1,34 @@
+//! 结果收集的内存上限。
+//!
+//! 超过上限后不再保存匹配，只继续计数，避免 `.` 这样的正则在大输入上产生上亿个结果把进程撑爆。
+//! 按每个结果实际写入的字节数累计，不含 Vec 扩容留下的余量，实际占用最多约为上限的两倍。
+
+pub struct Budget {
+    limit: usize, // 0 表示不限
+    used: usize,
+    closed: bool, // 超过上限后不再放行任何结果
+}
+
+impl Budget {
+    pub fn new(limit: usize) -> Self {
+        Self {
+            limit,
+            used: 0,
+            closed: false,
+        }
+    }
+
+    /// 记入一个结果的大小，超过上限时返回 false，这个结果及之后的结果都不应再保存
+    #[inline]
+    pub fn charge(&mut self, bytes: usize) -> bool {
+        if self.closed {
+            return false;
+        }
+        self.used = self.used.saturating_add(bytes);
+        if self.limit != 0 && self.used > self.limit {
+            self.closed = true;
+            return false;
+        }
+        true
+    }
+}
@@ -0,0 +1,101 @@
+use super::cppbridge::ffi::{CompileProfile, RegexOptions};
+use super::profile::timed;
+use regex_automata::{meta, MatchKind};
+use regex_syntax::{ast::Ast, hir::Hir};
+
+/// 一次解析得到的全部产物，语法树视图和匹配器共用同一份 AST
+pub struct Compiled {
+    pub ast: Ast,
+    pub hir: Hir,
+    pub re: meta::Regex,
+    pub profile: CompileProfile,
+}
+
+// regex 库默认的最大嵌套深度
+pub const DEFAULT_NEST_LIMIT: u32 = 250;
+
+pub fn nest_limit(options: &RegexOptions) -> u32 {
+    if options.nest_limit == 0 {
+        DEFAULT_NEST_LIMIT
+    } else {
+        options.nest_limit
+    }
+}
+
+pub fn parse(pattern: &str, options: &RegexOptions) -> Result<Ast, regex_syntax::ast::Error> {
+    regex_syntax::ast::parse::ParserBuilder::new()
+        .ignore_whitespace(options.ignore_whitespace)
+        .nest_limit(nest_limit(options))
+        .build()
+        .parse(pattern)
+}
+
+pub fn translate(
+    pattern: &str,
+    ast: &Ast,
+    options: &RegexOptions,
+) -> Result<Hir, regex_syntax::hir::Error> {
+    regex_syntax::hir::translate::TranslatorBuilder::new()
+        .case_insensitive(options.case_insensitive)
+        .multi_line(options.multi_line)
+        .dot_matches_new_line(options.dot_matches_new_line)
+        .unicode(options.unicode)
+        .crlf(options.crlf)
+        .line_terminator(options.line_terminator)
+        .swap_greed(options.swap_greed)
+        .utf8(true)
+        .build()
+        .translate(pattern, ast)
+}
+
+// 与 regex::RegexBuilder 的默认配置保持一致
+pub fn meta_config(options: &RegexOptions) -> meta::Config {
+    meta::Config::new()
+        .match_kind(MatchKind::LeftmostFirst)
+        .utf8_empty(true)
+        .nfa_size_limit(Some(10 * (1 << 20)))
+        .line_terminator(options.line_terminator)
+        .hybrid_cache_capacity(super::dfastats::cache_capacity(options))
+}
+
+// 搜索的输入总是 UTF-8 文本，匹配结果必须落在字符边界上。关闭 Unicode 后，
+// `.`、`[^a]`、`\W`、`\S` 等会匹配单个非 ASCII 字节，这样的正则无法编译，说明改写方法
+fn explain_translate_error(e: regex_syntax::hir::Error, options: &RegexOptions) -> anyhow::Error {
+    if options.unicode || *e.kind() != regex_syntax::hir::ErrorKind::InvalidUtf8 {
+        return e.into();
+    }
+    anyhow::anyhow!(
+        "{}\n关闭 Unicode 后，`.`、`[^a]`、`\\W`、`\\S` 等会匹配单个非 ASCII 字节，可能把一个字符从中间切开。\
+         请改写为 `(?u:.)`、`(?u:[^a])`，或只匹配 ASCII 的 `[\\x00-\\x7F]`",
+        e
+    )
+}
+
+pub fn compile(pattern: &str, options: &RegexOptions) -> anyhow::Result<Compiled> {
+    let _trace = super::trace::scope("compile");
+    let mut profile = CompileProfile::default();
+    let ast = timed(&mut profile, "解析语法", || parse(pattern, options))?;
+    // Unicode 类别在这一步展开，耗时计入 HIR 转换
+    let hir = timed(&mut profile, "转换 HIR", || translate(pattern, &ast, options));
+    let hir = hir.map_err(|e| explain_translate_error(e, options))?;
+    if options.profile {
+        super::profile::analyze(&ast, &hir, &mut profile)?;
+    }
+    // NFA、前缀过滤器和各个 DFA 都在这一步构建，meta 引擎没有公开各自的耗时
+    let re = timed(&mut profile, "构建匹配器", || {
+        meta::Builder::new()
+            .configure(meta_config(options))
+            .build_from_hir(&hir)
+    })?;
+    if options.profile {
+        profile.matcher_memory = re.memory_usage() as _;
+    } else {
+        profile.phases.clear();
+    }
+    Ok(Compiled {
+        ast,
+        hir,
+        re,
+        profile,
+    })
+}
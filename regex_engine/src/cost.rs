@@ -0,0 +1,165 @@
+//! 搜索之前根据 HIR 估算正则的搜索代价，对可能很慢的正则给出提示。
+
+use super::cppbridge::ffi::CostEstimate;
+use regex_automata::{
+    dfa::{dense, onepass},
+    nfa::thompson,
+    util::prefilter::Prefilter,
+    MatchKind,
+};
+use regex_syntax::hir::{self, Hir, HirKind};
+
+// 估算只是搜索前的检查，尝试构建完整 DFA 必须很快。超过这个大小就认为不可行，按代价高处理
+const DFA_SIZE_LIMIT: usize = 256 << 10;
+// 与 meta 引擎默认的单遍 DFA 上限相同，超过时 meta 引擎也不会使用单遍 DFA
+const ONEPASS_SIZE_LIMIT: usize = 1 << 20;
+// NFA 状态超过这个数量时已经评为代价高，不再尝试构建任何 DFA
+const DFA_MAX_NFA_STATES: usize = 1000;
+
+pub fn estimate(hir: &Hir) -> anyhow::Result<CostEstimate> {
+    let shape = hir::visit(hir, HirShape::default())?;
+    let nfa = thompson::Compiler::new()
+        .configure(thompson::Config::new().nfa_size_limit(Some(10 * (1 << 20))))
+        .build_from_hir(hir)?;
+    let prefilter = Prefilter::from_hir_prefix(MatchKind::LeftmostFirst, hir).is_some();
+    let small = nfa.states().len() <= DFA_MAX_NFA_STATES;
+    let onepass = small
+        && onepass::Builder::new()
+            .configure(onepass::Config::new().size_limit(Some(ONEPASS_SIZE_LIMIT)))
+            .build_from_nfa(nfa.clone())
+            .is_ok();
+    let full_dfa = small
+        && dense::Builder::new()
+            .configure(
+                dense::Config::new()
+                    .dfa_size_limit(Some(DFA_SIZE_LIMIT))
+                    .determinize_size_limit(Some(DFA_SIZE_LIMIT)),
+            )
+            .build_from_nfa(&nfa)
+            .is_ok();
+
+    let mut cost = CostEstimate {
+        nfa_states: nfa.states().len() as _,
+        class_ranges: shape.class_ranges.min(u32::MAX as usize) as _,
+        max_class_size: shape.max_class_size.min(u32::MAX as u64) as _,
+        repetition_blowup: shape.blowup(),
+        prefilter,
+        onepass,
+        full_dfa,
+        rating: 0,
+        warnings: vec![],
+    };
+    let mut score = 0;
+    let mut warn = |points: u8, message: String| {
+        score += points;
+        cost.warnings.push(message);
+    };
+    if cost.nfa_states > 10000 {
+        warn(
+            2,
+            format!(
+                "NFA 有 {} 个状态，懒惰 DFA 很容易反复清空缓存",
+                cost.nfa_states
+            ),
+        );
+    } else if cost.nfa_states > 1000 {
+        warn(1, format!("NFA 有 {} 个状态", cost.nfa_states));
+    }
+    if cost.repetition_blowup >= 100 {
+        warn(
+            1,
+            format!(
+                "计数重复展开后规模扩大约 {} 倍，如 \\w{{1,1000}}",
+                cost.repetition_blowup
+            ),
+        );
+    }
+    // 范围多的 Unicode 类编译成 UTF-8 自动机后状态很多，`.` 这种连续的大类则不会
+    if cost.class_ranges > 100 {
+        warn(
+            1,
+            format!(
+                "字符类共有 {} 个范围（最大的包含 {} 个字符），遇到非 ASCII 文本时状态数会增加",
+                cost.class_ranges, cost.max_class_size
+            ),
+        );
+    }
+    if !prefilter {
+        warn(1, "没有可用的前缀过滤器，需要逐字节扫描全部输入".into());
+    }
+    if !full_dfa {
+        warn(
+            1,
+            "无法在估算的限度内构建完整 DFA，只能使用懒惰 DFA 或更慢的引擎".into(),
+        );
+    }
+    cost.rating = score.min(3);
+    Ok(cost)
+}
+
+// 后序遍历，用栈记录每个子树展开计数重复前后的规模
+#[derive(Default)]
+struct HirShape {
+    sizes: Vec<(u64, u64)>,
+    class_ranges: usize,
+    max_class_size: u64,
+}
+
+impl HirShape {
+    fn blowup(&self) -> u64 {
+        let (plain, expanded) = self.sizes.last().copied().unwrap_or((1, 1));
+        (expanded / plain.max(1)).max(1)
+    }
+}
+
+impl hir::Visitor for HirShape {
+    type Output = Self;
+    type Err = std::convert::Infallible;
+
+    fn finish(self) -> Result<Self::Output, Self::Err> {
+        Ok(self)
+    }
+
+    fn visit_pre(&mut self, hir: &Hir) -> Result<(), Self::Err> {
+        let (ranges, size) = match hir.kind() {
+            HirKind::Class(hir::Class::Unicode(c)) => (
+                c.ranges().len(),
+                c.ranges()
+                    .iter()
+                    .map(|r| r.end() as u64 - r.start() as u64 + 1)
+                    .sum(),
+            ),
+            HirKind::Class(hir::Class::Bytes(c)) => (
+                c.ranges().len(),
+                c.ranges()
+                    .iter()
+                    .map(|r| r.end() as u64 - r.start() as u64 + 1)
+                    .sum(),
+            ),
+            _ => (0, 0),
+        };
+        self.class_ranges += ranges;
+        self.max_class_size = self.max_class_size.max(size);
+        Ok(())
+    }
+
+    fn visit_post(&mut self, hir: &Hir) -> Result<(), Self::Err> {
+        let children = match hir.kind() {
+            HirKind::Repetition(_) | HirKind::Capture(_) => 1,
+            HirKind::Concat(subs) | HirKind::Alternation(subs) => subs.len(),
+            _ => 0,
+        };
+        let at = self.sizes.len() - children;
+        let (plain, expanded) = self.sizes.drain(at..).fold((1u64, 1u64), |a, b| {
+            (a.0.saturating_add(b.0), a.1.saturating_add(b.1))
+        });
+        // 有上限的重复会被编译成 max 份，没有上限时是 min 份加一个循环
+        let copies = match hir.kind() {
+            HirKind::Repetition(rep) => rep.max.unwrap_or(rep.min.saturating_add(1)).max(1),
+            _ => 1,
+        };
+        self.sizes
+            .push((plain, expanded.saturating_mul(copies as u64)));
+        Ok(())
+    }
+}
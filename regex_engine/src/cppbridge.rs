@@ -1,11 +1,21 @@
 #[cxx::bridge]
-mod ffi {
+pub mod ffi {
+    // 语法树节点按先序排列，节点之间用下标相连，u32::MAX 表示不存在
     struct TreeNode {
-        title: String,
-        content: String,
+        parent: u32,
+        first_child: u32,
+        next_sibling: u32,
         start: u32,
         end: u32,
-        children: Vec<TreeNode>,
+        title_start: u32, // 在 ParseTree::strings 中的位置
+        title_len: u32,
+        content_start: u32,
+        content_len: u32,
+    }
+
+    struct ParseTree {
+        nodes: Vec<TreeNode>,
+        strings: String,
     }
 
     struct MatchGroup {
@@ -18,107 +28,1023 @@ mod ffi {
         groups: Vec<MatchGroup>,
     }
 
+    // 分组名称通过 regex_group_names 获取，不随每次匹配返回
     struct Matches {
+        matches: Vec<Match>,
+        density: Vec<u32>, // 每个桶内的匹配数量，未要求时为空，包括超过内存上限后省略的匹配
+        truncated: bool,   // 达到内存上限，matches 只是前一部分
+        skipped: u64,      // 省略的匹配数量
+    }
+
+    #[derive(Clone, PartialEq)]
+    struct RegexOptions {
+        ignore_whitespace: bool,    // 忽略空白
+        case_insensitive: bool,     // 忽略大小写
+        multi_line: bool,           // 多行模式，使 ^ 和 $ 匹配任意一行的行首行尾
+        dot_matches_new_line: bool, // 单行模式，点（.）可以匹配换行符
+        unicode: bool,              // Unicode 模式，关闭后 \w、\d 等只匹配 ASCII 字符
+        crlf: bool,                 // 多行模式下把 \r\n 当作行尾，. 也不匹配 \r
+        line_terminator: u8,        // 多行模式下的行终止符，默认为 \n
+        swap_greed: bool,           // 交换贪婪与非贪婪，a* 变为非贪婪，a*? 变为贪婪
+        nest_limit: u32,            // 最大嵌套深度，0 表示默认值
+        profile: bool,              // 分阶段构建并记录各阶段耗时
+        dfa_size_limit: usize,      // 懒惰 DFA 缓存大小，0 表示默认值
+    }
+
+    #[derive(Clone, Default)]
+    struct CompilePhase {
+        name: String,
+        micros: u64,
+    }
+
+    #[derive(Clone, Default)]
+    struct CompileProfile {
+        phases: Vec<CompilePhase>,
+        ast_nodes: u32,
+        hir_nodes: u32,
+        class_ranges: u32,   // 展开后的字符类范围总数
+        matcher_memory: u64, // 构建好的匹配器占用的内存，含 NFA、前缀过滤器等
+    }
+
+    struct DfaStats {
+        input_bytes: u64, // 搜索经过的输入长度，不含重复扫描的部分
+        matches: u64,
+        micros: u64,
+        cache_capacity: u64,
+        cache_clears: u64,
+        cache_memory: u64,
+        thrashing: bool,
+        suggested_capacity: u64,
+        not_applicable: String, // 非空时懒惰 DFA 无法处理这个输入，统计只到停止处为止
+    }
+
+    // 模式库中的一条，编译失败时 error 不为空
+    struct LibraryEntry {
+        name: String,
+        pattern: String,
+        micros: u64, // 编译耗时
+        memory: u64, // 编译后匹配器占用的内存
+        error: String,
+    }
+
+    // 磁盘结果集中的一页，按匹配顺序排列
+    struct StorePage {
+        index: u64, // 页号，页在文件中的位置为 index * page_bytes
+        rows: u32,
+        first_row: u64,
+    }
+
+    // 磁盘结果集的布局，格式见 matchstore.rs
+    struct StoreLayout {
+        path: String,
         group_names: Vec<String>,
+        rows: u64,
+        page_bytes: u64,
+        pages: Vec<StorePage>,
+        density: Vec<u32>, // 每个桶内的匹配数量，未要求时为空
+    }
+
+    // 搜索之前估算的代价，rating 越大越慢
+    #[derive(Clone)]
+    struct CostEstimate {
+        nfa_states: u32,
+        class_ranges: u32,
+        max_class_size: u32,    // 最大的字符类包含的字符数
+        repetition_blowup: u64, // 展开计数重复后规模扩大的倍数
+        prefilter: bool,
+        onepass: bool, // 可以用单遍 DFA 提取分组
+        full_dfa: bool,
+        rating: u8, // 0 低，1 中，2 高，3 很高
+        warnings: Vec<String>,
+    }
+
+    // 同一个正则在 Unicode 和 ASCII 模式下的对比，ascii_error 非空时 ASCII 模式无法编译
+    struct UnicodeAdvice {
+        sampled_bytes: u64, // 参与测速的输入长度
+        unicode_nfa_states: u32,
+        unicode_nfa_memory: u64,
+        unicode_micros: u64,
+        unicode_matches: u64,
+        ascii_nfa_states: u32,
+        ascii_nfa_memory: u64,
+        ascii_micros: u64,
+        ascii_matches: u64,
+        ascii_error: String,
+    }
+
+    // 按列存放的单个分组的全部捕获结果
+    struct GroupColumn {
+        spans: Vec<u32>,         // 每个匹配两项：起点、终点，未参与匹配时均为 u32::MAX
+        value_offsets: Vec<u32>, // 第 i 个值是 values[value_offsets[i]..value_offsets[i + 1]]
+        values: String,          // 所有捕获文本首尾相接
+    }
+
+    struct CaptureColumns {
+        len: usize, // 匹配数量
+        columns: Vec<GroupColumn>,
+        density: Vec<u32>,
+        truncated: bool,
+        skipped: u64,
+    }
+
+    // 替换结果中的一段与输入中对应匹配的位置，下标即匹配的序号
+    struct ReplaceSpan {
+        out_start: u32,
+        out_end: u32,
+        in_start: u32,
+        in_end: u32,
+    }
+
+    struct ReplaceResult {
+        text: String,
+        spans: Vec<ReplaceSpan>,
+    }
+
+    // 流式搜索的一批结果，匹配位置相对于 offset
+    struct StreamBatch {
+        offset: u64,
         matches: Vec<Match>,
+        eof: bool,
+    }
+
+    // 流式替换一块的结果，read 为至今已处理的输入字节数
+    struct ReplaceBatch {
+        read: u64,
+        count: u64,
+        eof: bool,
+    }
+
+    // 批量搜索字段时，一个字段中的第一个匹配，位置相对于字段的开头
+    struct FieldMatch {
+        field: u32,
+        start: u32,
+        end: u32,
+    }
+
+    // 抽样预览中的一个窗口，匹配位置相对于 offset。len 为窗口中完整行的长度，count 为其中的匹配总数
+    struct SampleWindow {
+        offset: u64,
+        len: u64,
+        count: u64,
+        matches: Vec<Match>, // 只保留前几个
+    }
+
+    // 抽样预览的结果，整个文件的匹配数量约为 estimate ± margin（95% 置信区间）。
+    // exact 时窗口覆盖了整个文件，estimate 就是匹配数量
+    struct SampleResult {
+        file_len: u64,
+        sampled: u64,
+        estimate: f64,
+        margin: f64,
+        exact: bool,
+        windows: Vec<SampleWindow>,
     }
 
     extern "Rust" {
         type Regex;
+        type Haystack;
+        type PatternLibrary;
+        type MatchStore;
+        type MatchResult;
+        type RegexStream;
+        type ReplaceTemplate;
+        type ReplaceStream;
 
-        fn regex_parse(s: &str, ignore_whitespace: bool) -> Result<TreeNode>;
-        fn regex_new(
+        fn regex_parse(s: &str, ignore_whitespace: bool) -> Result<ParseTree>;
+        fn regex_new(re: &str, options: &RegexOptions) -> Result<Box<Regex>>;
+        fn regex_clone(re: &Box<Regex>) -> Box<Regex>;
+        fn regex_analyze_and_build(
             re: &str,
-            ignore_whitespace: bool,
-            case_insensitive: bool,
-            multi_line: bool,
-            dot_matches_new_line: bool,
+            options: &RegexOptions,
+            tree: &mut ParseTree,
         ) -> Result<Box<Regex>>;
-        fn regex_match(re: &Box<Regex>, text: &str) -> Result<Matches>;
-        fn regex_replace(re: &Box<Regex>, text: &str, rep: &str) -> String;
-        fn regex_split(re: &Box<Regex>, text: &str) -> Vec<String>;
+        fn regex_profile(re: &Box<Regex>) -> CompileProfile;
+        fn regex_estimate_cost(re: &Box<Regex>) -> Result<CostEstimate>;
+        fn regex_group_count(re: &Box<Regex>) -> usize;
+        fn regex_group_names(re: &Box<Regex>) -> &[String];
+        fn regex_group_index(re: &Box<Regex>, name: &str) -> i32;
+        fn library_load(path: &str, options: &RegexOptions) -> Result<Box<PatternLibrary>>;
+        fn library_entries(lib: &Box<PatternLibrary>) -> &[LibraryEntry];
+        fn library_regex(
+            lib: &Box<PatternLibrary>,
+            index: usize,
+            options: &RegexOptions,
+            tree: &mut ParseTree,
+        ) -> Result<Box<Regex>>;
+        fn haystack_new(bytes: &[u8]) -> Result<Box<Haystack>>;
+        fn haystack_len(text: &Box<Haystack>) -> usize;
+        fn regex_match(
+            re: &Box<Regex>,
+            text: &Box<Haystack>,
+            density_buckets: usize,
+            memory_budget: usize,
+        ) -> Result<Matches>;
+        fn regex_match_columns(
+            re: &Box<Regex>,
+            text: &Box<Haystack>,
+            density_buckets: usize,
+            memory_budget: usize,
+        ) -> Result<CaptureColumns>;
+        fn regex_match_collect(
+            re: &Box<Regex>,
+            text: &Box<Haystack>,
+            density_buckets: usize,
+            memory_budget: usize,
+            cell_bytes: usize,
+        ) -> Result<Box<MatchResult>>;
+        fn match_result_columns(result: &Box<MatchResult>) -> &CaptureColumns;
+        fn match_result_spilled(result: &Box<MatchResult>) -> bool;
+        fn match_result_store(result: Box<MatchResult>) -> Result<Box<MatchStore>>;
+        fn store_matches(
+            re: &Box<Regex>,
+            text: &Box<Haystack>,
+            density_buckets: usize,
+        ) -> Result<Box<MatchStore>>;
+        fn store_layout(store: &Box<MatchStore>) -> &StoreLayout;
+        fn store_text(store: &Box<MatchStore>) -> &str;
+        fn template_new(re: &Box<Regex>, rep: &str) -> Result<Box<ReplaceTemplate>>;
+        fn regex_replace(
+            re: &Box<Regex>,
+            text: &Box<Haystack>,
+            rep: &Box<ReplaceTemplate>,
+        ) -> ReplaceResult;
+        fn regex_split(re: &Box<Regex>, text: &Box<Haystack>) -> Vec<String>;
+        fn regex_dfa_stats(re: &Box<Regex>, text: &Box<Haystack>) -> Result<DfaStats>;
+        fn regex_unicode_advice(
+            pattern: &str,
+            options: &RegexOptions,
+            text: &[u8],
+        ) -> Result<UnicodeAdvice>;
+        fn regex_save_results(
+            re: &Box<Regex>,
+            text: &Box<Haystack>,
+            path: &str,
+            with_values: bool,
+        ) -> Result<u64>;
+        fn pool_set_threads(threads: usize);
+        fn pool_threads() -> usize;
+        fn regex_stream_fd(
+            re: &Box<Regex>,
+            fd: i32,
+            buffer_size: usize,
+        ) -> Result<Box<RegexStream>>;
+        fn regex_stream_next(stream: &mut Box<RegexStream>) -> Result<StreamBatch>;
+        fn regex_match_fields(
+            re: &Box<Regex>,
+            text: &[u8],
+            ends: &[u32],
+        ) -> Result<Vec<FieldMatch>>;
+        fn regex_sample_fd(
+            re: &Box<Regex>,
+            fd: i32,
+            windows: usize,
+            window_size: usize,
+            limit: usize,
+        ) -> Result<SampleResult>;
+        fn regex_replace_stream_fd(
+            re: &Box<Regex>,
+            rep: &Box<ReplaceTemplate>,
+            in_fd: i32,
+            out_fd: i32,
+            buffer_size: usize,
+        ) -> Result<Box<ReplaceStream>>;
+        fn regex_replace_stream_next(stream: &mut Box<ReplaceStream>) -> Result<ReplaceBatch>;
+        fn trace_enabled() -> bool;
+        fn trace_now() -> u64;
+        fn trace_record(name: &str, start: u64);
+        fn trace_flush() -> Result<()>;
     }
 }
 
-fn conv_tree(tree: &super::tree::Tree<super::parse::TreeItem>) -> ffi::TreeNode {
-    let mut children = vec![];
-    for i in tree.children().iter() {
-        children.push(conv_tree(i));
-    }
-    let content = tree.content();
-    ffi::TreeNode {
-        title: content.title.clone(),
-        content: content.content.clone(),
-        start: content.span.start,
-        end: content.span.end,
-        children,
+use super::library::PatternLibrary;
+use super::matchstore::MatchStore;
+
+pub const NO_NODE: u32 = u32::MAX;
+
+fn conv_tree(tree: &super::tree::Tree<super::parse::TreeItem>) -> ffi::ParseTree {
+    let mut nodes: Vec<ffi::TreeNode> = vec![];
+    let mut strings = String::new();
+    // 标题种类很少，重复的只保存一份
+    let mut titles = std::collections::HashMap::new();
+    let mut stack = vec![(tree.clone(), NO_NODE)];
+    // 每个节点最后一个子节点的下标，用来连接兄弟节点
+    let mut last_child: Vec<u32> = vec![];
+    while let Some((node, parent)) = stack.pop() {
+        let index = nodes.len() as u32;
+        let content = node.content();
+        let (title_start, title_len) = *titles.entry(content.title.clone()).or_insert_with(|| {
+            let start = strings.len() as u32;
+            strings.push_str(&content.title);
+            (start, content.title.len() as u32)
+        });
+        let content_start = strings.len() as u32;
+        strings.push_str(&content.content);
+        nodes.push(ffi::TreeNode {
+            parent,
+            first_child: NO_NODE,
+            next_sibling: NO_NODE,
+            start: content.span.start,
+            end: content.span.end,
+            title_start,
+            title_len,
+            content_start,
+            content_len: content.content.len() as u32,
+        });
+        last_child.push(NO_NODE);
+        if parent != NO_NODE {
+            let prev = last_child[parent as usize];
+            if prev == NO_NODE {
+                nodes[parent as usize].first_child = index;
+            } else {
+                nodes[prev as usize].next_sibling = index;
+            }
+            last_child[parent as usize] = index;
+        }
+        // 逆序压栈，保证子节点按原顺序出栈
+        for i in node.children().iter().rev() {
+            stack.push((i.clone(), index));
+        }
     }
+    ffi::ParseTree { nodes, strings }
 }
 
-pub fn regex_parse(s: &str, ignore_whitespace: bool) -> anyhow::Result<ffi::TreeNode> {
+pub fn regex_parse(s: &str, ignore_whitespace: bool) -> anyhow::Result<ffi::ParseTree> {
     let ast = super::parse::parse(s, ignore_whitespace)?;
     Ok(conv_tree(&ast))
 }
 
+#[derive(Clone)]
 pub struct Regex {
-    re: regex::Regex,
+    re: regex_automata::meta::Regex,
+    hir: regex_syntax::hir::Hir,
+    id: std::sync::Arc<super::pool::RegexId>, // 副本共用同一个编号和各线程中的缓存
+    line_local: bool,
+    pattern: String,
+    options: ffi::RegexOptions,
+    profile: ffi::CompileProfile,
+    // 分组信息在编译时整理一次，之后每次匹配都不再重新收集
+    group_names: Vec<String>, // 未命名的分组为空字符串
+    group_index: std::collections::HashMap<String, u32>,
+    // 估算代价要尝试构建单遍 DFA 和完整 DFA，第一次用到时才计算，之后直接复用
+    cost: std::sync::OnceLock<Result<ffi::CostEstimate, String>>,
+}
+
+impl Regex {
+    pub(crate) fn new(
+        pattern: &str,
+        options: &ffi::RegexOptions,
+        compiled: super::compile::Compiled,
+    ) -> Self {
+        let line_local = !super::parallel::can_match_newline(&compiled.hir);
+        let group_names = group_names(&compiled.re);
+        let group_index = group_names
+            .iter()
+            .enumerate()
+            .filter(|(_, name)| !name.is_empty())
+            .map(|(i, name)| (name.clone(), i as u32))
+            .collect();
+        Self {
+            re: compiled.re,
+            hir: compiled.hir,
+            id: std::sync::Arc::new(super::pool::RegexId::new()),
+            line_local,
+            pattern: pattern.to_string(),
+            options: options.clone(),
+            profile: compiled.profile,
+            group_names,
+            group_index,
+            cost: std::sync::OnceLock::new(),
+        }
+    }
+
+    pub(crate) fn searchable(&self) -> super::parallel::Searchable {
+        super::parallel::Searchable {
+            id: self.id.get(),
+            re: &self.re,
+            line_local: self.line_local,
+        }
+    }
 }
 
-pub fn regex_new(
+pub fn regex_new(re: &str, options: &ffi::RegexOptions) -> anyhow::Result<Box<Regex>> {
+    let compiled = super::compile::compile(re, options)?;
+    Ok(Box::new(Regex::new(re, options, compiled)))
+}
+
+// 后台任务使用自己的副本，界面线程随后替换或释放正则不会影响它
+pub fn regex_clone(re: &Box<Regex>) -> Box<Regex> {
+    Box::new(Regex::clone(re))
+}
+
+// 只解析一次，语法树和匹配器共用同一份 AST
+pub fn regex_analyze_and_build(
     re: &str,
-    ignore_whitespace: bool,    // 忽略空白
-    case_insensitive: bool,     // 忽略大小写
-    multi_line: bool,           // 多行模式，使 ^ 和 $ 匹配任意一行的行首行尾
-    dot_matches_new_line: bool, // 单行模式，点（.）可以匹配换行符
+    options: &ffi::RegexOptions,
+    tree: &mut ffi::ParseTree,
 ) -> anyhow::Result<Box<Regex>> {
-    let re = regex::RegexBuilder::new(re)
-        .ignore_whitespace(ignore_whitespace)
-        .case_insensitive(case_insensitive)
-        .multi_line(multi_line)
-        .dot_matches_new_line(dot_matches_new_line)
-        .build()?;
-    Ok(Box::new(Regex { re }))
+    let compiled = super::compile::compile(re, options)?;
+    let _trace = super::trace::scope("build parse tree");
+    *tree = conv_tree(&super::parse::tree_from_ast(&compiled.ast)?);
+    Ok(Box::new(Regex::new(re, options, compiled)))
 }
 
-pub fn regex_match(re: &Box<Regex>, text: &str) -> anyhow::Result<ffi::Matches> {
-    let re = &re.re;
-    let group_names = re
-        .capture_names()
-        .into_iter()
+pub fn regex_profile(re: &Box<Regex>) -> ffi::CompileProfile {
+    re.profile.clone()
+}
+
+pub fn regex_estimate_cost(re: &Box<Regex>) -> anyhow::Result<ffi::CostEstimate> {
+    re.cost
+        .get_or_init(|| super::cost::estimate(&re.hir).map_err(|e| e.to_string()))
+        .clone()
+        .map_err(anyhow::Error::msg)
+}
+
+// 在线程池上并行编译模式库中的全部正则
+pub fn library_load(
+    path: &str,
+    options: &ffi::RegexOptions,
+) -> anyhow::Result<Box<PatternLibrary>> {
+    Ok(Box::new(super::library::load(path, options)?))
+}
+
+pub fn library_entries(lib: &Box<PatternLibrary>) -> &[ffi::LibraryEntry] {
+    &lib.entries
+}
+
+// 选项与加载时相同时直接复制已编译的正则，否则按新的选项重新编译
+// 同时生成展开后的正则的语法树。选项与加载时相同时直接使用已编译的正则和保存的 AST
+pub fn library_regex(
+    lib: &Box<PatternLibrary>,
+    index: usize,
+    options: &ffi::RegexOptions,
+    tree: &mut ffi::ParseTree,
+) -> anyhow::Result<Box<Regex>> {
+    let entry = lib
+        .entries
+        .get(index)
+        .ok_or_else(|| anyhow::anyhow!("模式库中没有第 {} 项", index))?;
+    if lib.invalid[index] {
+        anyhow::bail!("{}", entry.error);
+    }
+    let mut compare = options.clone();
+    compare.profile = false;
+    match &lib.regexes[index] {
+        Some((re, ast)) if compare == lib.options && !options.profile => {
+            let _trace = super::trace::scope("build parse tree");
+            *tree = conv_tree(&super::parse::tree_from_ast(ast)?);
+            Ok(Box::new(re.clone()))
+        }
+        _ => regex_analyze_and_build(&entry.pattern, options, tree),
+    }
+}
+
+// 包括代表整个匹配的第 0 组
+pub fn regex_group_count(re: &Box<Regex>) -> usize {
+    re.group_names.len()
+}
+
+pub fn regex_group_names(re: &Box<Regex>) -> &[String] {
+    &re.group_names
+}
+
+// 按名称查找分组的序号，不存在时返回 -1
+pub fn regex_group_index(re: &Box<Regex>, name: &str) -> i32 {
+    re.group_index.get(name).map_or(-1, |&i| i as i32)
+}
+
+pub(crate) fn conv_groups(caps: &regex_automata::util::captures::Captures, text: &[u8]) -> Vec<ffi::MatchGroup> {
+    caps.iter()
+        .map(|g| match g {
+            Some(g) => ffi::MatchGroup {
+                text: String::from_utf8_lossy(&text[g.range()]).into_owned(),
+                start: g.start as _,
+                end: g.end as _,
+            },
+            None => ffi::MatchGroup {
+                text: String::new(),
+                start: 0,
+                end: 0,
+            },
+        })
+        .collect()
+}
+
+fn group_names(re: &regex_automata::meta::Regex) -> Vec<String> {
+    re.group_info()
+        .pattern_names(regex_automata::PatternID::ZERO)
         .map(|i| i.unwrap_or_default().to_string())
-        .collect::<Vec<_>>();
+        .collect()
+}
+
+// 已经检查过 UTF-8 的输入，创建一次后可以反复搜索，不必每次调用都重新测量长度和检查编码
+pub struct Haystack {
+    text: std::sync::Arc<str>, // 磁盘结果集截取分组的值时共用这一份
+}
+
+impl Haystack {
+    pub fn as_str(&self) -> &str {
+        &self.text
+    }
+
+    pub fn shared(&self) -> std::sync::Arc<str> {
+        self.text.clone()
+    }
+}
+
+// 按长度传入，中间的 NUL 字节不会截断输入
+pub fn haystack_new(bytes: &[u8]) -> anyhow::Result<Box<Haystack>> {
+    let _trace = super::trace::scope("validate input");
+    let text = std::str::from_utf8(bytes)
+        .map_err(|e| anyhow::anyhow!("输入不是有效的 UTF-8，位置 {}", e.valid_up_to()))?;
+    Ok(Box::new(Haystack { text: text.into() }))
+}
+
+pub fn haystack_len(text: &Box<Haystack>) -> usize {
+    text.text.len()
+}
+
+// memory_budget 为结果占用内存的上限，0 表示不限。超过后不再提取分组，只用更快的搜索继续计数
+pub fn regex_match(
+    re: &Box<Regex>,
+    text: &Box<Haystack>,
+    density_buckets: usize,
+    memory_budget: usize,
+) -> anyhow::Result<ffi::Matches> {
+    use regex_automata::util::iter::Searcher;
+    let _trace = super::trace::scope("search and collect");
+    let re = &re.re;
+    let text = text.as_str();
+    let mut density = super::density::Density::new(density_buckets, text.as_bytes());
+    let mut budget = super::budget::Budget::new(memory_budget);
     let mut matches = vec![];
-    for i in re.captures_iter(text) {
-        let mut amatch = vec![];
-        for g in i.iter() {
-            let group = match g {
-                Some(g) => ffi::MatchGroup {
-                    text: g.as_str().to_string(),
-                    start: g.start() as _,
-                    end: g.end() as _,
-                },
-                None => ffi::MatchGroup {
-                    text: String::new(),
-                    start: 0,
-                    end: 0,
-                },
-            };
-            amatch.push(group);
+    let mut skipped = 0;
+    let mut caps = re.create_captures();
+    let mut it = Searcher::new(regex_automata::Input::new(text));
+    while let Some(m) = it.advance(|input| {
+        if skipped == 0 {
+            re.search_captures(input, &mut caps);
+            Ok(caps.get_match())
+        } else {
+            Ok(re.search(input))
         }
-        matches.push(ffi::Match { groups: amatch });
+    }) {
+        density.add(m.start());
+        if skipped == 0 {
+            let groups = conv_groups(&caps, text.as_bytes());
+            let size = std::mem::size_of::<ffi::Match>()
+                + groups
+                    .iter()
+                    .map(|g| std::mem::size_of::<ffi::MatchGroup>() + g.text.len())
+                    .sum::<usize>();
+            if budget.charge(size) {
+                matches.push(ffi::Match { groups });
+                continue;
+            }
+        }
+        skipped += 1;
     }
     Ok(ffi::Matches {
-        group_names,
         matches,
+        density: density.into_counts(),
+        truncated: skipped != 0,
+        skipped,
+    })
+}
+
+pub const NO_SPAN: u32 = u32::MAX;
+
+pub fn regex_match_columns(
+    re: &Box<Regex>,
+    text: &Box<Haystack>,
+    density_buckets: usize,
+    memory_budget: usize,
+) -> anyhow::Result<ffi::CaptureColumns> {
+    Ok(collect_columns(re, text, density_buckets, memory_budget, None)?.columns)
+}
+
+// 界面显示的匹配结果，超过内存上限时改为磁盘结果集，columns 为空
+pub struct MatchResult {
+    columns: ffi::CaptureColumns,
+    store: Option<MatchStore>,
+}
+
+// 与 regex_match_columns 相同，但每个单元格另计 cell_bytes 和值的三倍作为表格的开销。
+// 超过上限时把已收集的结果和之后的匹配接着写入磁盘结果集，整个输入只搜索一遍
+pub fn regex_match_collect(
+    re: &Box<Regex>,
+    text: &Box<Haystack>,
+    density_buckets: usize,
+    memory_budget: usize,
+    cell_bytes: usize,
+) -> anyhow::Result<Box<MatchResult>> {
+    Ok(Box::new(collect_columns(
+        re,
+        text,
+        density_buckets,
+        memory_budget,
+        Some(cell_bytes),
+    )?))
+}
+
+pub fn match_result_columns(result: &Box<MatchResult>) -> &ffi::CaptureColumns {
+    &result.columns
+}
+
+pub fn match_result_spilled(result: &Box<MatchResult>) -> bool {
+    result.store.is_some()
+}
+
+pub fn match_result_store(result: Box<MatchResult>) -> anyhow::Result<Box<MatchStore>> {
+    match result.store {
+        Some(store) => Ok(Box::new(store)),
+        None => anyhow::bail!("结果没有写入磁盘"),
+    }
+}
+
+// spill 为每个单元格的表格开销，给出时超过上限后转存到磁盘，否则只计数
+fn collect_columns(
+    regex: &Regex,
+    text: &Haystack,
+    density_buckets: usize,
+    memory_budget: usize,
+    spill: Option<usize>,
+) -> anyhow::Result<MatchResult> {
+    use regex_automata::util::iter::Searcher;
+    // 搜索和整理结果在同一个循环中交替进行，无法分开计时
+    let _trace = super::trace::scope("search and collect");
+    let re = &regex.re;
+    let text_str = text.as_str();
+    let mut columns = (0..re.group_info().group_len(regex_automata::PatternID::ZERO))
+        .map(|_| ffi::GroupColumn {
+            spans: vec![],
+            value_offsets: vec![0],
+            values: String::new(),
+        })
+        .collect::<Vec<_>>();
+    let mut density = super::density::Density::new(density_buckets, text_str.as_bytes());
+    let mut budget = super::budget::Budget::new(memory_budget);
+    // 复用同一个 Captures，不为每个匹配分配内存
+    let mut caps = re.create_captures();
+    let mut it = Searcher::new(regex_automata::Input::new(text_str));
+    let mut len = 0;
+    let mut skipped = 0;
+    while let Some(m) = it.advance(|input| {
+        if skipped == 0 {
+            re.search_captures(input, &mut caps);
+            Ok(caps.get_match())
+        } else {
+            Ok(re.search(input))
+        }
+    }) {
+        density.add(m.start());
+        // 每个分组占一对起止位置、一个值偏移，再加上值本身。开始省略后 caps 不再更新
+        let fits = skipped == 0
+            && budget.charge(
+                (0..columns.len())
+                    .map(|i| {
+                        let value = caps.get_group(i).map_or(0, |span| span.len());
+                        12 + value + spill.map_or(0, |cell| cell + value * 3)
+                    })
+                    .sum(),
+            );
+        if !fits && spill.is_some() {
+            let store = super::matchstore::build_sequential(
+                &regex.group_names,
+                text.shared(),
+                density_buckets,
+                |w| {
+                    for m in 0..len {
+                        w.push_spans(columns.iter().map(|column| {
+                            match (column.spans[m * 2], column.spans[m * 2 + 1]) {
+                                (NO_SPAN, _) => (u64::MAX, u64::MAX),
+                                (start, end) => (start as u64, end as u64),
+                            }
+                        }));
+                    }
+                    w.push(&caps);
+                    while it
+                        .advance(|input| {
+                            re.search_captures(input, &mut caps);
+                            Ok(caps.get_match())
+                        })
+                        .is_some()
+                    {
+                        w.push(&caps);
+                    }
+                },
+            )?;
+            return Ok(MatchResult {
+                columns: ffi::CaptureColumns {
+                    len: 0,
+                    columns: vec![],
+                    density: vec![],
+                    truncated: false,
+                    skipped: 0,
+                },
+                store: Some(store),
+            });
+        }
+        if !fits {
+            skipped += 1;
+            continue;
+        }
+        for (i, column) in columns.iter_mut().enumerate() {
+            match caps.get_group(i) {
+                Some(span) => {
+                    column.spans.push(span.start as _);
+                    column.spans.push(span.end as _);
+                    column.values.push_str(&text_str[span.range()]);
+                }
+                None => {
+                    column.spans.push(NO_SPAN);
+                    column.spans.push(NO_SPAN);
+                }
+            }
+            column.value_offsets.push(column.values.len() as _);
+        }
+        len += 1;
+    }
+    Ok(MatchResult {
+        columns: ffi::CaptureColumns {
+            len,
+            columns,
+            density: density.into_counts(),
+            truncated: skipped != 0,
+            skipped,
+        },
+        store: None,
     })
 }
 
-pub fn regex_replace(re: &Box<Regex>, text: &str, rep: &str) -> String {
+// 把全部匹配写入临时文件，结果集大小不受内存限制。MatchStore 保留一份输入，用来截取分组的值
+pub fn store_matches(
+    re: &Box<Regex>,
+    text: &Box<Haystack>,
+    density_buckets: usize,
+) -> anyhow::Result<Box<MatchStore>> {
+    let _trace = super::trace::scope("store matches");
+    Ok(Box::new(super::matchstore::build(
+        &re.searchable(),
+        &re.group_names,
+        text.shared(),
+        density_buckets,
+    )?))
+}
+
+pub fn store_layout(store: &Box<MatchStore>) -> &ffi::StoreLayout {
+    &store.layout
+}
+
+pub fn store_text(store: &Box<MatchStore>) -> &str {
+    &store.text
+}
+
+pub struct ReplaceTemplate {
+    template: super::template::Template,
+}
+
+// 模板在创建时就按正则的分组检查引用，之后可以反复使用
+pub fn template_new(re: &Box<Regex>, rep: &str) -> anyhow::Result<Box<ReplaceTemplate>> {
+    let template = super::template::Template::new(rep, re.re.group_info())?;
+    Ok(Box::new(ReplaceTemplate { template }))
+}
+
+pub fn regex_replace(
+    re: &Box<Regex>,
+    text: &Box<Haystack>,
+    rep: &Box<ReplaceTemplate>,
+) -> ffi::ReplaceResult {
+    let _trace = super::trace::scope("replace");
     let re = &re.re;
-    re.replace_all(text, rep).to_string()
+    let text = text.as_str();
+    let mut result = String::with_capacity(text.len());
+    let mut spans = vec![];
+    let mut last = 0;
+    for caps in re.captures_iter(text) {
+        let Some(m) = caps.get_match() else {
+            continue;
+        };
+        result.push_str(&text[last..m.start()]);
+        let out_start = result.len();
+        rep.template.expand(&caps, text, &mut result);
+        spans.push(ffi::ReplaceSpan {
+            out_start: out_start as _,
+            out_end: result.len() as _,
+            in_start: m.start() as _,
+            in_end: m.end() as _,
+        });
+        last = m.end();
+    }
+    result.push_str(&text[last..]);
+    ffi::ReplaceResult {
+        text: result,
+        spans,
+    }
 }
 
-pub fn regex_split(re: &Box<Regex>, text: &str) -> Vec<String> {
+pub fn regex_split(re: &Box<Regex>, text: &Box<Haystack>) -> Vec<String> {
+    let _trace = super::trace::scope("split");
     let re = &re.re;
-    re.split(text).map(|i| i.to_string()).collect()
+    let text = text.as_str();
+    re.split(text).map(|i| text[i.range()].to_string()).collect()
+}
+
+pub fn regex_dfa_stats(re: &Box<Regex>, text: &Box<Haystack>) -> anyhow::Result<ffi::DfaStats> {
+    super::dfastats::run(&re.pattern, &re.options, text.as_str())
+}
+
+// 把全部匹配写入二进制结果文件，格式见 resultfile.rs，返回匹配数量
+pub fn regex_save_results(
+    re: &Box<Regex>,
+    text: &Box<Haystack>,
+    path: &str,
+    with_values: bool,
+) -> anyhow::Result<u64> {
+    let _trace = super::trace::scope("save results");
+    super::resultfile::write(&re.searchable(), text.as_str(), path, with_values)
+}
+
+// 设置引擎线程池的线程数，0 表示使用全部核心
+pub fn pool_set_threads(threads: usize) {
+    super::pool::set_threads(threads)
+}
+
+pub fn pool_threads() -> usize {
+    super::pool::global().threads()
+}
+
+// 不依赖 Regex 对象，可以在后台线程中调用。只检查取样部分的编码
+pub fn regex_unicode_advice(
+    pattern: &str,
+    options: &ffi::RegexOptions,
+    text: &[u8],
+) -> anyhow::Result<ffi::UnicodeAdvice> {
+    super::unicode::advise(pattern, options, text)
+}
+
+pub struct RegexStream {
+    re: regex_automata::meta::Regex,
+    buf: super::stream::LineBuffer<super::stream::FdFile>,
+}
+
+pub fn regex_stream_fd(
+    re: &Box<Regex>,
+    fd: i32,
+    buffer_size: usize,
+) -> anyhow::Result<Box<RegexStream>> {
+    // 块内的匹配位置用 u32 表示
+    let buffer_size = buffer_size.clamp(4096, u32::MAX as usize);
+    Ok(Box::new(RegexStream {
+        re: re.re.clone(),
+        buf: super::stream::LineBuffer::new(super::stream::fd_file(fd)?, buffer_size)
+            .terminator(re.options.line_terminator),
+    }))
+}
+
+pub fn regex_stream_next(stream: &mut Box<RegexStream>) -> anyhow::Result<ffi::StreamBatch> {
+    let _trace = super::trace::scope("stream batch");
+    let RegexStream { re, buf } = &mut **stream;
+    let Some(chunk) = buf.next_chunk()? else {
+        return Ok(ffi::StreamBatch {
+            offset: 0,
+            matches: vec![],
+            eof: true,
+        });
+    };
+    let hay = chunk.haystack;
+    let matches = re
+        .captures_iter(regex_automata::Input::new(hay).range(chunk.range.clone()))
+        .take_while(|caps| {
+            caps.get_match()
+                .is_some_and(|m| chunk.last || m.start() < chunk.range.end)
+        })
+        .map(|i| ffi::Match {
+            groups: conv_groups(&i, hay),
+        })
+        .collect();
+    Ok(ffi::StreamBatch {
+        offset: chunk.offset,
+        matches,
+        eof: false,
+    })
+}
+
+// 分别搜索 text 中的每个字段，第 i 个字段为 text[ends[i - 1]..ends[i]]，只返回有匹配的字段
+pub fn regex_match_fields(
+    re: &Box<Regex>,
+    text: &[u8],
+    ends: &[u32],
+) -> anyhow::Result<Vec<ffi::FieldMatch>> {
+    super::fields::search(&re.searchable(), text, ends)
+}
+
+// 在文件中均匀地取 windows 个窗口并行搜索，每个窗口最多返回 limit 个匹配
+pub fn regex_sample_fd(
+    re: &Box<Regex>,
+    fd: i32,
+    windows: usize,
+    window_size: usize,
+    limit: usize,
+) -> anyhow::Result<ffi::SampleResult> {
+    let _trace = super::trace::scope("sample file");
+    let file = super::stream::fd_file(fd)?;
+    super::sample::sample(
+        &re.searchable(),
+        re.options.line_terminator,
+        file.file(),
+        windows,
+        window_size,
+        limit,
+    )
+}
+
+pub struct ReplaceStream {
+    re: regex_automata::meta::Regex,
+    template: super::template::Template,
+    input: super::stream::LineBuffer<super::stream::FdFile>,
+    output: std::io::BufWriter<super::stream::FdFile>,
+    result: Vec<u8>,
+}
+
+// 逐块替换输入流并写入输出流，每次调用 regex_replace_stream_next 处理一块
+pub fn regex_replace_stream_fd(
+    re: &Box<Regex>,
+    rep: &Box<ReplaceTemplate>,
+    in_fd: i32,
+    out_fd: i32,
+    buffer_size: usize,
+) -> anyhow::Result<Box<ReplaceStream>> {
+    // 与 regex_stream_fd 相同，过小的块会强行切断长行
+    let buffer_size = buffer_size.clamp(4096, u32::MAX as usize);
+    Ok(Box::new(ReplaceStream {
+        re: re.re.clone(),
+        template: rep.template.clone(),
+        input: super::stream::LineBuffer::new(super::stream::fd_file(in_fd)?, buffer_size)
+            .terminator(re.options.line_terminator),
+        output: std::io::BufWriter::new(super::stream::fd_file(out_fd)?),
+        result: vec![],
+    }))
+}
+
+pub fn regex_replace_stream_next(
+    stream: &mut Box<ReplaceStream>,
+) -> anyhow::Result<ffi::ReplaceBatch> {
+    use std::io::Write;
+    let _trace = super::trace::scope("stream replace batch");
+    let ReplaceStream {
+        re,
+        template,
+        input,
+        output,
+        result,
+    } = &mut **stream;
+    let Some(chunk) = input.next_chunk()? else {
+        output.flush()?;
+        return Ok(ffi::ReplaceBatch {
+            read: 0,
+            count: 0,
+            eof: true,
+        });
+    };
+    let hay = chunk.haystack;
+    result.clear();
+    let mut last = chunk.range.start;
+    let mut count = 0;
+    for caps in re.captures_iter(regex_automata::Input::new(hay).range(chunk.range.clone())) {
+        let Some(m) = caps.get_match() else {
+            continue;
+        };
+        // 块末尾的空匹配留给下一块
+        if m.start() >= chunk.range.end && !chunk.last {
+            break;
+        }
+        result.extend_from_slice(&hay[last..m.start()]);
+        template.expand_bytes(&caps, hay, result);
+        last = m.end();
+        count += 1;
+    }
+    result.extend_from_slice(&hay[last..chunk.range.end]);
+    output.write_all(result)?;
+    Ok(ffi::ReplaceBatch {
+        read: chunk.offset + chunk.range.end as u64,
+        count,
+        eof: false,
+    })
+}
+
+// 界面一侧的计时：先取 trace_now()，阶段结束时把名称和起点交给 trace_record
+pub fn trace_enabled() -> bool {
+    super::trace::enabled()
+}
+
+pub fn trace_now() -> u64 {
+    super::trace::now()
+}
+
+pub fn trace_record(name: &str, start: u64) {
+    super::trace::record("ui", name, start)
+}
+
+pub fn trace_flush() -> anyhow::Result<()> {
+    super::trace::flush()
 }
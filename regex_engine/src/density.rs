@@ -0,0 +1,83 @@
+/// 固定桶数的匹配密度直方图，每个桶对应输入中相同数量的行。
+///
+/// 编辑框的滚动条按行滚动，按行分桶后缩略条上的位置与滚动条一致，
+/// 界面按比例换算成行号即可跳转，不必在字节偏移和字符之间转换。
+pub struct Density {
+    starts: Vec<usize>, // 每个桶第一行的起点，不减
+    counts: Vec<u32>,
+}
+
+// 分块统计换行符，之后只需在一块之内逐字节查找
+const BLOCK: usize = 4096;
+
+fn count_lines(block: &[u8]) -> usize {
+    block.iter().filter(|&&b| b == b'\n').count()
+}
+
+impl Density {
+    pub fn new(buckets: usize, text: &[u8]) -> Self {
+        if buckets == 0 {
+            return Self {
+                starts: vec![],
+                counts: vec![],
+            };
+        }
+        let blocks: Vec<usize> = text.chunks(BLOCK).map(count_lines).collect();
+        let lines = blocks.iter().sum::<usize>() + 1;
+        let mut starts = Vec::with_capacity(buckets);
+        // block 之前的块中共有 before 个换行符
+        let mut block = 0;
+        let mut before = 0;
+        for i in 0..buckets {
+            // 第 i 个桶从第 line 行开始，即第 line 个换行符之后
+            let line = (i as u64 * lines as u64 / buckets as u64) as usize;
+            if line == 0 {
+                starts.push(0);
+                continue;
+            }
+            while before + blocks[block] < line {
+                before += blocks[block];
+                block += 1;
+            }
+            let mut pos = block * BLOCK;
+            let mut need = line - before;
+            loop {
+                if text[pos] == b'\n' {
+                    need -= 1;
+                    if need == 0 {
+                        break;
+                    }
+                }
+                pos += 1;
+            }
+            starts.push(pos + 1);
+        }
+        Self {
+            starts,
+            counts: vec![0; buckets],
+        }
+    }
+
+    /// pos 所在的行对应的桶。行数少于桶数时一行占几个桶，返回其中的第一个
+    #[inline]
+    pub fn bucket(&self, pos: usize) -> Option<usize> {
+        let i = self.starts.partition_point(|&s| s <= pos).checked_sub(1)?;
+        Some(self.starts.partition_point(|&s| s < self.starts[i]))
+    }
+
+    pub fn buckets(&self) -> usize {
+        self.counts.len()
+    }
+
+    #[inline]
+    pub fn add(&mut self, pos: usize) {
+        if let Some(i) = self.bucket(pos) {
+            let count = &mut self.counts[i];
+            *count = count.saturating_add(1);
+        }
+    }
+
+    pub fn into_counts(self) -> Vec<u32> {
+        self.counts
+    }
+}
@@ -0,0 +1,101 @@
+use std::time::Instant;
+
+use super::cppbridge::ffi::{DfaStats, RegexOptions};
+use regex_automata::{
+    hybrid,
+    nfa::thompson,
+    util::{iter::Searcher, look::LookMatcher, syntax},
+    Input, MatchErrorKind,
+};
+
+// regex 库默认的懒惰 DFA 缓存大小
+pub const DEFAULT_CACHE_CAPACITY: usize = 2 * (1 << 20);
+
+pub fn cache_capacity(options: &RegexOptions) -> usize {
+    if options.dfa_size_limit == 0 {
+        DEFAULT_CACHE_CAPACITY
+    } else {
+        options.dfa_size_limit
+    }
+}
+
+/// 直接用懒惰 DFA 搜索一遍，统计缓存的使用情况。
+///
+/// 正常情况下 meta 引擎会在缓存反复清空时悄悄退回到 PikeVM，
+/// 这里关闭了这种退出机制，以便观察缓存本身的表现。
+/// 含有 Unicode 单词边界的正则遇到非 ASCII 字符时懒惰 DFA 无法继续，这时在结果中注明并停止。
+pub fn run(pattern: &str, options: &RegexOptions, text: &str) -> anyhow::Result<DfaStats> {
+    let capacity = cache_capacity(options);
+    let mut look_matcher = LookMatcher::new();
+    look_matcher.set_line_terminator(options.line_terminator);
+    let re = hybrid::regex::Builder::new()
+        .syntax(
+            syntax::Config::new()
+                .ignore_whitespace(options.ignore_whitespace)
+                .case_insensitive(options.case_insensitive)
+                .multi_line(options.multi_line)
+                .dot_matches_new_line(options.dot_matches_new_line)
+                .unicode(options.unicode)
+                .crlf(options.crlf)
+                .line_terminator(options.line_terminator)
+                .swap_greed(options.swap_greed)
+                .nest_limit(super::compile::nest_limit(options))
+                .utf8(true),
+        )
+        .thompson(thompson::Config::new().look_matcher(look_matcher))
+        .dfa(
+            hybrid::dfa::Config::new()
+                .cache_capacity(capacity)
+                .unicode_word_boundary(true)
+                .minimum_cache_clear_count(None),
+        )
+        .build(pattern)?;
+    let mut cache = re.create_cache();
+
+    let now = Instant::now();
+    let mut matches = 0u64;
+    let mut input_bytes = text.len() as u64;
+    let mut not_applicable = String::new();
+    let mut it = Searcher::new(Input::new(text));
+    loop {
+        match it.try_advance(|input| re.try_search(&mut cache, input)) {
+            Ok(Some(_)) => matches += 1,
+            Ok(None) => break,
+            Err(e) => match *e.kind() {
+                MatchErrorKind::Quit { offset, .. } => {
+                    input_bytes = offset as u64;
+                    not_applicable = format!(
+                        "懒惰 DFA 不适用（Unicode 单词边界）：第 {} 字节处的非 ASCII 字符无法判断 \\b",
+                        offset
+                    );
+                    break;
+                }
+                _ => return Err(e.into()),
+            },
+        }
+    }
+    let micros = now.elapsed().as_micros() as u64;
+
+    let clears = (cache.forward().clear_count() + cache.reverse().clear_count()) as u64;
+    // 两次清空之间前进的距离还不如缓存本身大，说明缓存中的状态几乎没有被复用。
+    // 按输入长度计算，反向查找起点时还会重复扫描，实际扫描的字节数只会更多
+    let thrashing = clears >= 3 && input_bytes / clears < capacity as u64;
+    let suggested = if thrashing {
+        (capacity as u64 * (clears + 1))
+            .next_power_of_two()
+            .min(1 << 30)
+    } else {
+        capacity as u64
+    };
+    Ok(DfaStats {
+        input_bytes,
+        matches,
+        micros,
+        cache_capacity: capacity as _,
+        cache_clears: clears,
+        cache_memory: cache.memory_usage() as _,
+        thrashing,
+        suggested_capacity: suggested,
+        not_applicable,
+    })
+}
@@ -0,0 +1,47 @@
+//! 批量搜索大量短字段，如 CSV 中选定的列。
+//!
+//! 调用方把一批字段首尾相接放在同一块缓冲区中，另给出每个字段的结束位置。
+//! 每个字段单独作为输入搜索，`^`、`$` 对应字段的首尾。字段按数量平分到线程池上，
+//! 每个线程使用自己的缓存，只报告每个字段中的第一个匹配。
+
+use regex_automata::Input;
+
+use super::cppbridge::ffi;
+use super::parallel::Searchable;
+
+// 每个任务至少搜索这么多字段，字段很短，太少时调度开销比搜索本身还大
+const MIN_FIELDS: usize = 4096;
+
+pub fn search(s: &Searchable, text: &[u8], ends: &[u32]) -> anyhow::Result<Vec<ffi::FieldMatch>> {
+    if ends.windows(2).any(|w| w[0] > w[1])
+        || ends.last().map_or(false, |&e| e as usize > text.len())
+    {
+        anyhow::bail!("字段的结束位置无效");
+    }
+    let pool = super::pool::global();
+    let parts = (ends.len() / MIN_FIELDS).clamp(1, pool.threads() * 4);
+    let per_part = ends.len().div_ceil(parts).max(1);
+    let ranges: Vec<_> = (0..ends.len())
+        .step_by(per_part)
+        .map(|start| start..(start + per_part).min(ends.len()))
+        .collect();
+    let results = pool.map(ranges, |range| {
+        let _trace = super::trace::scope("search fields");
+        super::pool::with_cache(s.id, s.re, |cache| {
+            let mut found = vec![];
+            for i in range {
+                let start = if i == 0 { 0 } else { ends[i - 1] as usize };
+                let field = &text[start..ends[i] as usize];
+                if let Some(m) = s.re.search_with(cache, &Input::new(field)) {
+                    found.push(ffi::FieldMatch {
+                        field: i as u32,
+                        start: m.start() as u32,
+                        end: m.end() as u32,
+                    });
+                }
+            }
+            found
+        })
+    });
+    Ok(results.into_iter().flatten().collect())
+}
@@ -1,8 +1,29 @@
 #![allow(unused_variables)]
 
+#[cfg(feature = "bench")]
+pub mod bench;
+mod budget;
+mod compile;
+mod cost;
 mod cppbridge;
+mod density;
+mod dfastats;
+mod fields;
+mod library;
+mod matchstore;
+mod parallel;
 mod parse;
+mod pool;
+mod profile;
+#[cfg(feature = "bench")]
+pub mod regress;
+mod resultfile;
+mod sample;
+mod stream;
+mod template;
+mod trace;
 mod tree;
+mod unicode;
 
 #[cfg(test)]
 mod tests {
@@ -16,6 +37,782 @@ mod tests {
         Ok(())
     }
 
+    // 依次取出全部块，返回 (块在流中的偏移, 块的内容, 前面上下文的长度, 是否最后一块)
+    fn chunks(input: &[u8], capacity: usize, terminator: u8) -> Vec<(u64, Vec<u8>, usize, bool)> {
+        let mut buf = super::stream::LineBuffer::new(input, capacity).terminator(terminator);
+        let mut chunks = vec![];
+        while let Some(c) = buf.next_chunk().unwrap() {
+            chunks.push((
+                c.offset + c.range.start as u64,
+                c.haystack[c.range.clone()].to_vec(),
+                c.range.start,
+                c.last,
+            ));
+        }
+        chunks
+    }
+
+    #[test]
+    fn stream_chunks_keep_whole_lines() {
+        let input: &[u8] = b"abc\ndef\nlonger line here\ntail";
+        let expect: Vec<(u64, &[u8], usize, bool)> = vec![
+            (0, b"abc\ndef\n", 0, false),
+            // 单行超过缓冲区，强制切分
+            (8, b"longer l", 4, false),
+            (16, b"ine here", 4, false),
+            (24, b"\n", 4, false),
+            (25, b"tail", 4, true),
+        ];
+        let got = chunks(input, 12, b'\n');
+        assert_eq!(
+            got.iter()
+                .map(|(o, c, s, l)| (*o, c.as_slice(), *s, *l))
+                .collect::<Vec<_>>(),
+            expect
+        );
+    }
+
+    #[test]
+    fn stream_chunks_use_terminator() {
+        let input: &[u8] = b"ab\0cd\nef\0\0g";
+        let got = chunks(input, 12, 0);
+        let expect: Vec<(u64, &[u8], usize, bool)> =
+            vec![(0, b"ab\0cd\nef\0\0", 0, false), (10, b"g", 4, true)];
+        assert_eq!(
+            got.iter()
+                .map(|(o, c, s, l)| (*o, c.as_slice(), *s, *l))
+                .collect::<Vec<_>>(),
+            expect
+        );
+    }
+
+    // 块边界不影响结果：流式搜索和替换与一次搜索整个输入相同
+    #[cfg(unix)]
+    #[test]
+    fn stream_matches_across_chunks() {
+        use super::cppbridge::*;
+        use std::os::fd::AsRawFd;
+        let text: String = (0..5000)
+            .map(|i| format!("k{} = v{} {}\n", i, i % 7, "x".repeat(i % 5)))
+            .collect();
+        let dir = std::env::temp_dir();
+        let input = dir.join(format!("regex_tool_stream_{}.txt", std::process::id()));
+        let output = dir.join(format!("regex_tool_stream_{}.out", std::process::id()));
+        std::fs::write(&input, &text).unwrap();
+        let mut options = options();
+        options.multi_line = false;
+        let haystack = haystack_new(text.as_bytes()).unwrap();
+        for pattern in [
+            r"^k\d",
+            r"\Ak0",
+            r"(?m)^k\d+",
+            r"\bv3\b",
+            r"x+$",
+            r"x?",
+            r"\z",
+        ] {
+            let re = regex_new(pattern, &options).unwrap();
+            let expect: Vec<_> = re
+                .searchable()
+                .re
+                .find_iter(text.as_bytes())
+                .map(|m| (m.start() as u64, m.end() as u64))
+                .collect();
+            let file = std::fs::File::open(&input).unwrap();
+            let mut stream = regex_stream_fd(&re, file.as_raw_fd(), 4096).unwrap();
+            let mut got = vec![];
+            loop {
+                let batch = regex_stream_next(&mut stream).unwrap();
+                if batch.eof {
+                    break;
+                }
+                for m in &batch.matches {
+                    let g = &m.groups[0];
+                    got.push((batch.offset + g.start as u64, batch.offset + g.end as u64));
+                }
+            }
+            assert_eq!(got, expect, "{}", pattern);
+
+            let rep = template_new(&re, "<$0>").unwrap();
+            let file = std::fs::File::open(&input).unwrap();
+            let out = std::fs::File::create(&output).unwrap();
+            let mut stream =
+                regex_replace_stream_fd(&re, &rep, file.as_raw_fd(), out.as_raw_fd(), 0).unwrap();
+            let mut count = 0;
+            loop {
+                let batch = regex_replace_stream_next(&mut stream).unwrap();
+                if batch.eof {
+                    break;
+                }
+                count += batch.count;
+            }
+            drop(stream);
+            drop(out);
+            assert_eq!(count, expect.len() as u64, "{}", pattern);
+            assert_eq!(
+                std::fs::read_to_string(&output).unwrap(),
+                regex_replace(&re, &haystack, &rep).text,
+                "{}",
+                pattern
+            );
+        }
+        let _ = std::fs::remove_file(&input);
+        let _ = std::fs::remove_file(&output);
+    }
+
+    #[cfg(unix)]
+    #[test]
+    fn sample_counts_exactly_or_estimates() {
+        use super::cppbridge::*;
+        use std::os::fd::AsRawFd;
+        // 夹杂几行很长的行，完整搜索时会跨过切分点
+        let text: String = (0..100000)
+            .map(|i| match i % 20000 {
+                7 => format!("{} {} long\n", "y".repeat(70000), i),
+                _ => format!("row {} {}\n", i, if i % 10 == 0 { "hit" } else { "miss" }),
+            })
+            .collect();
+        let path = std::env::temp_dir().join(format!("regex_tool_sample_{}", std::process::id()));
+        std::fs::write(&path, &text).unwrap();
+        let file = std::fs::File::open(&path).unwrap();
+        let re = regex_new(r"\d+ (hit|long)", &options()).unwrap();
+        let expect = text.matches(" hit").count() + text.matches(" long").count();
+
+        // 窗口能覆盖整个文件时分块完整搜索，各块首尾相接，长度之和就是文件长度
+        let result = regex_sample_fd(&re, file.as_raw_fd(), 32, 1 << 20, 5).unwrap();
+        assert!(result.exact);
+        assert_eq!(result.windows.len(), 32);
+        assert_eq!(result.sampled, text.len() as u64);
+        assert_eq!(result.estimate, expect as f64);
+        assert_eq!(result.margin, 0.0);
+        for w in &result.windows {
+            for m in &w.matches {
+                let g = &m.groups[0];
+                let at = (w.offset + g.start as u64) as usize;
+                assert_eq!(&text[at..at + g.text.len()], g.text);
+            }
+        }
+
+        // 能跨行的正则不能按行切分，超过一个窗口时只抽样
+        let multi = regex_new(r"hit\nrow", &options()).unwrap();
+        let result = regex_sample_fd(&multi, file.as_raw_fd(), 32, 1 << 20, 5).unwrap();
+        assert!(!result.exact);
+
+        drop(file);
+
+        // 抽样估算的误差范围应当覆盖真实的数量。长行所在的窗口没有完整的行，这里只用短行
+        let text: String = (0..100000)
+            .map(|i| format!("row {} {}\n", i, if i % 10 == 0 { "hit" } else { "miss" }))
+            .collect();
+        std::fs::write(&path, &text).unwrap();
+        let file = std::fs::File::open(&path).unwrap();
+        let result = regex_sample_fd(&re, file.as_raw_fd(), 16, 16 << 10, 5).unwrap();
+        assert!(!result.exact);
+        assert_eq!(result.windows.len(), 16);
+        assert!(result.sampled < text.len() as u64);
+        assert!(
+            (result.estimate - 10000.0).abs() <= result.margin,
+            "{} ± {}",
+            result.estimate,
+            result.margin
+        );
+        assert!(result.windows.iter().all(|w| w.matches.len() <= 5));
+        drop(file);
+        std::fs::remove_file(&path).unwrap();
+    }
+
+    #[test]
+    fn cost_estimate_rates_patterns() {
+        use super::cppbridge::*;
+        let re = regex_new(r"error: (\d+)", &options()).unwrap();
+        let cost = regex_estimate_cost(&re).unwrap();
+        assert!(cost.prefilter);
+        assert!(cost.onepass);
+        assert!(cost.full_dfa);
+        assert_eq!(cost.rating, 0, "{:?}", cost.warnings);
+        assert!(cost.warnings.is_empty());
+
+        // 计数重复的 Unicode 类 NFA 很大，不再尝试构建 DFA，直接评为代价很高
+        let re = regex_new(r"\w{100}", &options()).unwrap();
+        let cost = regex_estimate_cost(&re).unwrap();
+        assert!(cost.nfa_states > 10000);
+        assert!(cost.repetition_blowup >= 100);
+        assert!(!cost.full_dfa);
+        assert!(!cost.onepass);
+        assert_eq!(cost.rating, 3);
+        // 结果缓存在正则中，第二次直接返回
+        let again = regex_estimate_cost(&re).unwrap();
+        assert_eq!(again.nfa_states, cost.nfa_states);
+        assert_eq!(again.warnings, cost.warnings);
+
+        // ASCII 模式下同样的正则小得多
+        let mut ascii = options();
+        ascii.unicode = false;
+        let re = regex_new(r"\w{20}", &ascii).unwrap();
+        let cost = regex_estimate_cost(&re).unwrap();
+        assert!(cost.nfa_states < 1000);
+        assert!(cost.class_ranges < 100);
+    }
+
+    #[test]
+    fn budget_stays_closed_after_limit() {
+        let mut budget = super::budget::Budget::new(100);
+        assert!(budget.charge(60));
+        assert!(budget.charge(40));
+        // 超过上限后，即使更小的结果也不再放行
+        assert!(!budget.charge(1));
+        assert!(!budget.charge(0));
+        let mut budget = super::budget::Budget::new(100);
+        assert!(budget.charge(90));
+        assert!(!budget.charge(20));
+        assert!(!budget.charge(5));
+        // 0 表示不限
+        let mut unlimited = super::budget::Budget::new(0);
+        assert!(unlimited.charge(usize::MAX));
+        assert!(unlimited.charge(usize::MAX));
+    }
+
+    #[test]
+    fn match_columns_layout_and_budget() {
+        use super::cppbridge::*;
+        let text = haystack_new("a=1 b= cc=22".as_bytes()).unwrap();
+        let re = regex_new(r"(\w+)=(\d+)?", &options()).unwrap();
+        let result = regex_match_columns(&re, &text, 0, 0).unwrap();
+        assert_eq!(result.len, 3);
+        assert_eq!(result.columns.len(), 3);
+        assert!(!result.truncated && result.skipped == 0);
+        assert!(result.density.is_empty());
+        // 每列依次保存每个匹配的起止位置，值首尾相接，value_offsets 比匹配数多一项
+        let whole = &result.columns[0];
+        assert_eq!(whole.spans, [0, 3, 4, 6, 7, 12]);
+        assert_eq!(whole.values, "a=1b=cc=22");
+        assert_eq!(whole.value_offsets, [0, 3, 5, 10]);
+        assert_eq!(result.columns[1].values, "abcc");
+        // 未参与匹配的分组位置为 NO_SPAN，值为空
+        let digits = &result.columns[2];
+        assert_eq!(digits.spans, [2, 3, NO_SPAN, NO_SPAN, 10, 12]);
+        assert_eq!(digits.values, "122");
+        assert_eq!(digits.value_offsets, [0, 1, 1, 3]);
+
+        // 超过上限后只计数，已保存的结果与不限时的前几个相同
+        let lines: String = (0..1000).map(|i| format!("k{}={}\n", i, i)).collect();
+        let text = haystack_new(lines.as_bytes()).unwrap();
+        let all = regex_match_columns(&re, &text, 10, 0).unwrap();
+        let limited = regex_match_columns(&re, &text, 10, 4096).unwrap();
+        assert_eq!(all.len, 1000);
+        assert!(limited.truncated);
+        assert!(limited.len > 0 && limited.len < all.len);
+        assert_eq!(limited.len as u64 + limited.skipped, 1000);
+        assert_eq!(limited.density, all.density);
+        let kept = limited.len * 2;
+        assert_eq!(limited.columns[0].spans, all.columns[0].spans[..kept]);
+        assert_eq!(
+            limited.columns[2].value_offsets,
+            all.columns[2].value_offsets[..=limited.len]
+        );
+    }
+
+    #[test]
+    fn match_fields_reports_first_match_per_field() {
+        use super::cppbridge::*;
+        let fields = ["abc12", "", "x", "7up 8", "^no"];
+        let mut text = String::new();
+        let mut ends = vec![];
+        for f in fields {
+            text.push_str(f);
+            ends.push(text.len() as u32);
+        }
+        // 每个字段单独作为输入，^ 对应字段的开头，位置相对于字段
+        let re = regex_new(r"^\d|\d+$", &options()).unwrap();
+        let found = regex_match_fields(&re, text.as_bytes(), &ends).unwrap();
+        let found: Vec<_> = found.iter().map(|m| (m.field, m.start, m.end)).collect();
+        assert_eq!(found, [(0, 3, 5), (3, 0, 1)]);
+        let re = regex_new(r"^$", &options()).unwrap();
+        let found = regex_match_fields(&re, text.as_bytes(), &ends).unwrap();
+        assert_eq!(found.len(), 1);
+        assert_eq!(found[0].field, 1);
+
+        // 字段很多时分到多个线程上搜索，结果仍按字段顺序排列
+        let mut text = String::new();
+        let mut ends = vec![];
+        for i in 0..50000 {
+            text.push_str(&format!("v{}", i));
+            ends.push(text.len() as u32);
+        }
+        let re = regex_new(r"7$", &options()).unwrap();
+        let found = regex_match_fields(&re, text.as_bytes(), &ends).unwrap();
+        assert_eq!(found.len(), 5000);
+        assert!(found.windows(2).all(|w| w[0].field < w[1].field));
+        assert!(found.iter().all(|m| m.field % 10 == 7));
+
+        // 结束位置递减或超出缓冲区时报错
+        assert!(regex_match_fields(&re, b"abc", &[2, 1]).is_err());
+        assert!(regex_match_fields(&re, b"abc", &[4]).is_err());
+    }
+
+    // 按页表顺序读出磁盘结果集中每个匹配各分组的起止位置
+    fn read_store(store: &super::matchstore::MatchStore) -> Vec<Vec<(u64, u64)>> {
+        let layout = &store.layout;
+        let data = std::fs::read(&layout.path).unwrap();
+        let groups = layout.group_names.len();
+        let mut rows = vec![];
+        for page in &layout.pages {
+            let start = (page.index * layout.page_bytes) as usize;
+            let records = &data[start..start + page.rows as usize * groups * 16];
+            for record in records.chunks(groups * 16) {
+                let at = |i: usize| u64::from_le_bytes(record[i..i + 8].try_into().unwrap());
+                rows.push((0..groups).map(|g| (at(g * 16), at(g * 16 + 8))).collect());
+            }
+        }
+        rows
+    }
+
+    #[test]
+    fn over_budget_results_spill_to_store() {
+        use super::cppbridge::*;
+        let mut lines = String::new();
+        for i in 0..5000 {
+            lines.push_str(&format!("{} {}\n", i, if i % 3 == 0 { "x" } else { "" }));
+        }
+        let text = haystack_new(lines.as_bytes()).unwrap();
+        // 可以为空的匹配和未参与匹配的分组在转存前后都要保持一致
+        let re = regex_new(r"\d*( x)?", &options()).unwrap();
+        let meta = regex_automata::meta::Regex::new(r"\d*( x)?").unwrap();
+        let expect: Vec<Vec<(u64, u64)>> = meta
+            .captures_iter(lines.as_str())
+            .map(|caps| {
+                (0..caps.group_len())
+                    .map(|i| {
+                        caps.get_group(i)
+                            .map_or((u64::MAX, u64::MAX), |s| (s.start as u64, s.end as u64))
+                    })
+                    .collect()
+            })
+            .collect();
+        let all = regex_match_columns(&re, &text, 50, 0).unwrap();
+        assert_eq!(all.len, expect.len());
+
+        // 上限足够时在内存中整理，与不限时相同
+        let result = regex_match_collect(&re, &text, 50, 1 << 30, 256).unwrap();
+        assert!(!match_result_spilled(&result));
+        assert_eq!(match_result_columns(&result).len, expect.len());
+        assert!(match_result_store(result).is_err());
+
+        // 超过上限后已收集的结果和之后的匹配都写入磁盘，与一次完整搜索的结果相同
+        let result = regex_match_collect(&re, &text, 50, 64 << 10, 256).unwrap();
+        assert!(match_result_spilled(&result));
+        let store = match_result_store(result).unwrap();
+        assert_eq!(store_layout(&store).rows, expect.len() as u64);
+        assert_eq!(store_layout(&store).density, all.density);
+        assert_eq!(read_store(&store), expect);
+    }
+
+    // 用模板替换 text 中的第一个匹配
+    fn expand(rep: &str, text: &str) -> anyhow::Result<String> {
+        let re = regex_automata::meta::Regex::new(r"(?P<word>[a-z]+)-(\d+)")?;
+        let template = super::template::Template::new(rep, re.group_info())?;
+        let mut caps = re.create_captures();
+        re.captures(text, &mut caps);
+        let mut result = String::new();
+        template.expand(&caps, text, &mut result);
+        Ok(result)
+    }
+
+    #[test]
+    fn template_expands_groups() {
+        assert_eq!(expand("$2:$1", "abc-42").unwrap(), "42:abc");
+        assert_eq!(expand("<${word}>", "abc-42").unwrap(), "<abc>");
+        assert_eq!(expand("$word.", "abc-42").unwrap(), "abc.");
+        assert_eq!(expand("${1}a", "abc-42").unwrap(), "abca");
+        assert_eq!(expand("$$1 $$$2", "abc-42").unwrap(), "$1 $42");
+        assert_eq!(expand("$ $", "abc-42").unwrap(), "$ $");
+        assert_eq!(expand("${word", "abc-42").unwrap(), "${word");
+    }
+
+    #[test]
+    fn template_rejects_missing_groups() {
+        assert!(expand("$3", "abc-42").is_err());
+        assert!(expand("${name}", "abc-42").is_err());
+        assert!(expand("$name", "abc-42").is_err());
+        // 与 regex 库一致，$1a 引用的是名为 1a 的分组
+        assert!(expand("$1a", "abc-42").is_err());
+        assert!(expand("${}", "abc-42").is_err());
+    }
+
+    fn options() -> super::cppbridge::ffi::RegexOptions {
+        super::cppbridge::ffi::RegexOptions {
+            ignore_whitespace: false,
+            case_insensitive: false,
+            multi_line: true,
+            dot_matches_new_line: false,
+            unicode: true,
+            crlf: false,
+            line_terminator: b'\n',
+            swap_greed: false,
+            nest_limit: 0,
+            profile: false,
+            dfa_size_limit: 0,
+        }
+    }
+
+    #[test]
+    fn ascii_mode_explains_rejected_patterns() {
+        let mut options = options();
+        options.unicode = false;
+        assert!(super::compile::compile(r"\w+\d", &options).is_ok());
+        assert!(super::compile::compile(r"(?u:.)(?u:[^a])[\x00-\x7F]", &options).is_ok());
+        for pattern in [".", "[^a]", r"\W", r"\S"] {
+            let Err(e) = super::compile::compile(pattern, &options) else {
+                panic!("{} 不应能编译", pattern);
+            };
+            assert!(e.to_string().contains("(?u:.)"), "{}", e);
+        }
+        assert!(!super::compile::compile("(", &options)
+            .err()
+            .unwrap()
+            .to_string()
+            .contains("(?u:.)"));
+    }
+
+    #[test]
+    fn library_expands_references() {
+        let path = std::env::temp_dir().join(format!("regex_tool_library_{}", std::process::id()));
+        std::fs::write(
+            &path,
+            "# 注释\n\
+             NUM \\d+\n\
+             PAIR %{NUM:a}-%{NUM}\n\
+             REPEAT x%{2}\n\
+             LATER %{AFTER}\n\
+             AFTER y\n\
+             EMPTY\n\
+             BROKEN (\n\
+             USES_BROKEN %{BROKEN}\n\
+             USES_EMPTY %{EMPTY:e:int}\n",
+        )
+        .unwrap();
+        let lib = super::library::load(path.to_str().unwrap(), &options()).unwrap();
+        std::fs::remove_file(&path).unwrap();
+        let entry = |name: &str| {
+            let i = lib.entries.iter().position(|e| e.name == name).unwrap();
+            (&lib.entries[i], lib.regexes[i].is_some(), lib.invalid[i])
+        };
+
+        let (pair, compiled, _) = entry("PAIR");
+        assert_eq!(pair.pattern, r"(?P<a>\d+)-(?:\d+)");
+        assert!(compiled && pair.error.is_empty());
+        let (repeat, compiled, _) = entry("REPEAT");
+        assert_eq!(repeat.pattern, "x%{2}");
+        assert!(compiled);
+        assert!(entry("LATER").0.error.contains("未定义"));
+        assert!(entry("AFTER").1);
+        assert!(entry("EMPTY").0.error.contains("缺少正则"));
+        assert!(entry("USES_EMPTY").0.error.contains("本身有错误"));
+        // 编译失败的条目仍可引用，错误在引用它的条目编译时报告
+        let (broken, compiled, invalid) = entry("BROKEN");
+        assert!(!compiled && !invalid && !broken.error.is_empty());
+        let (uses_broken, compiled, invalid) = entry("USES_BROKEN");
+        assert!(!compiled && !invalid && !uses_broken.error.is_empty());
+        for name in ["LATER", "EMPTY", "USES_EMPTY"] {
+            let i = lib.entries.iter().position(|e| e.name == name).unwrap();
+            assert!(lib.invalid[i] && lib.regexes[i].is_none());
+        }
+
+        // 选中条目时语法树与正则一起返回，与直接编译展开后的正则相同
+        use super::cppbridge::*;
+        let new_tree = || ffi::ParseTree {
+            nodes: vec![],
+            strings: String::new(),
+        };
+        let i = lib.entries.iter().position(|e| e.name == "PAIR").unwrap();
+        let lib = Box::new(lib);
+        let mut expect = new_tree();
+        regex_analyze_and_build(r"(?P<a>\d+)-(?:\d+)", &options(), &mut expect).unwrap();
+        let mut changed = options();
+        changed.case_insensitive = true;
+        for options in [options(), changed] {
+            let mut tree = new_tree();
+            let re = library_regex(&lib, i, &options, &mut tree).unwrap();
+            assert_eq!(tree.nodes.len(), expect.nodes.len());
+            assert_eq!(tree.strings, expect.strings);
+            assert_eq!(regex_group_names(&re), ["", "a"]);
+        }
+    }
+
+    #[test]
+    fn density_buckets_follow_lines() {
+        // 第一行很长，按字节分桶时后面的短行会挤在最后一个桶里
+        let mut text = "x".repeat(10000);
+        text.push_str("\na\nb\nc");
+        let density = super::density::Density::new(4, text.as_bytes());
+        assert_eq!(density.bucket(0), Some(0));
+        assert_eq!(density.bucket(9999), Some(0));
+        assert_eq!(density.bucket(10001), Some(1));
+        assert_eq!(density.bucket(10003), Some(2));
+        assert_eq!(density.bucket(text.len()), Some(3));
+        // 行数少于桶数时，一行的匹配都计入这一行的第一个桶
+        let density = super::density::Density::new(8, b"ab\ncd");
+        assert_eq!(density.bucket(1), Some(0));
+        assert_eq!(density.bucket(4), Some(4));
+        assert_eq!(super::density::Density::new(3, b"").bucket(0), Some(0));
+
+        // 写入磁盘时统计的密度与在内存中整理结果时相同
+        let mut lines = String::new();
+        for i in 0..20000 {
+            lines.push_str(&format!("{}{}\n", "y".repeat(i % 97), i % 7));
+        }
+        let text = super::cppbridge::haystack_new(lines.as_bytes()).unwrap();
+        let re = super::cppbridge::regex_new(r"[35]$", &options()).unwrap();
+        let columns = super::cppbridge::regex_match_columns(&re, &text, 300, 0).unwrap();
+        let store = super::cppbridge::store_matches(&re, &text, 300).unwrap();
+        assert_eq!(
+            columns.density.iter().map(|&n| n as usize).sum::<usize>(),
+            columns.len
+        );
+        assert_eq!(
+            super::cppbridge::store_layout(&store).density,
+            columns.density
+        );
+    }
+
+    // 按界面 ResultFileModel::open 和 value 的方式读取结果文件，返回分组名和每个匹配各分组的值
+    fn read_results(path: &std::path::Path) -> (Vec<String>, Vec<Vec<Option<String>>>) {
+        let data = std::fs::read(path).unwrap();
+        let u32_at =
+            |i: u64| u32::from_le_bytes(data[i as usize..i as usize + 4].try_into().unwrap());
+        let u64_at =
+            |i: u64| u64::from_le_bytes(data[i as usize..i as usize + 8].try_into().unwrap());
+        let size = data.len() as u64;
+        assert_eq!(&data[..8], super::resultfile::MAGIC);
+        assert_eq!(u32_at(8), super::resultfile::VERSION);
+        let group_count = u32_at(12) as u64;
+        let match_count = u64_at(16);
+        let has_values = u32_at(24) & super::resultfile::FLAG_VALUES != 0;
+        let (names_offset, records_offset) = (u64_at(32), u64_at(40));
+        let (heap_offset, heap_len) = (u64_at(48), u64_at(56));
+        let entry_size = if has_values { 24 } else { 16 };
+        let record_size = group_count * entry_size;
+        assert!(records_offset <= size);
+        assert!(match_count <= (size - records_offset) / record_size);
+        assert!(!has_values || heap_offset + heap_len <= size);
+        let mut names = vec![];
+        let mut pos = names_offset;
+        for _ in 0..group_count {
+            let len = u32_at(pos) as u64;
+            assert!(pos + 4 + len <= records_offset);
+            names.push(
+                String::from_utf8(data[(pos + 4) as usize..(pos + 4 + len) as usize].to_vec())
+                    .unwrap(),
+            );
+            pos += 4 + len;
+        }
+        let rows = (0..match_count)
+            .map(|row| {
+                (0..group_count)
+                    .map(|g| {
+                        let entry = records_offset + row * record_size + g * entry_size;
+                        let (start, end) = (u64_at(entry), u64_at(entry + 8));
+                        if start == super::resultfile::NO_OFFSET {
+                            return None;
+                        }
+                        if !has_values {
+                            return Some(format!("({}, {})", start, end));
+                        }
+                        let offset = heap_offset + u64_at(entry + 16);
+                        assert!(offset + end - start <= heap_offset + heap_len);
+                        Some(
+                            String::from_utf8(
+                                data[offset as usize..(offset + end - start) as usize].to_vec(),
+                            )
+                            .unwrap(),
+                        )
+                    })
+                    .collect()
+            })
+            .collect();
+        (names, rows)
+    }
+
+    #[test]
+    fn result_file_round_trip() {
+        let text = "k1=v1; kk=; k3=值3; =x;";
+        let haystack = super::cppbridge::haystack_new(text.as_bytes()).unwrap();
+        let path = std::env::temp_dir().join(format!("regex_tool_results_{}", std::process::id()));
+        for (pattern, with_values) in [
+            (r"(?P<key>\w+)=(\w+)?;", true),
+            (r"(?P<key>\w+)=(\w+)?;", false),
+            ("nothing", true),
+        ] {
+            let re = super::cppbridge::regex_new(pattern, &options()).unwrap();
+            let count = super::cppbridge::regex_save_results(
+                &re,
+                &haystack,
+                path.to_str().unwrap(),
+                with_values,
+            )
+            .unwrap();
+            let (names, rows) = read_results(&path);
+            let s = re.searchable();
+            let expected: Vec<Vec<Option<String>>> =
+                s.re.captures_iter(text.as_bytes())
+                    .map(|caps| {
+                        (0..caps.group_len())
+                            .map(|g| {
+                                caps.get_group(g).map(|span| match with_values {
+                                    true => text[span.range()].to_string(),
+                                    false => format!("({}, {})", span.start, span.end),
+                                })
+                            })
+                            .collect()
+                    })
+                    .collect();
+            assert_eq!(count, expected.len() as u64);
+            assert_eq!(rows, expected, "{}", pattern);
+            let expected_names = if pattern == "nothing" {
+                vec![""]
+            } else {
+                vec!["", "key", ""]
+            };
+            assert_eq!(names, expected_names);
+        }
+        std::fs::remove_file(&path).unwrap();
+        assert!(!path.with_extension("heap").exists());
+    }
+
+    #[test]
+    fn released_regex_drops_thread_caches() {
+        let re = super::cppbridge::regex_new(r"\w+", &options()).unwrap();
+        let copy = super::cppbridge::regex_clone(&re);
+        let s = re.searchable();
+        super::pool::with_cache(s.id, s.re, |_| {});
+        let cached = super::pool::cached_regexes();
+        // 副本共用缓存，只释放副本时缓存仍然保留
+        drop(copy);
+        super::pool::with_cache(s.id, s.re, |_| {});
+        assert_eq!(super::pool::cached_regexes(), cached);
+        drop(re);
+        assert_eq!(super::pool::cached_regexes(), cached - 1);
+    }
+
+    #[test]
+    fn dfa_stats_detect_thrashing() {
+        use super::cppbridge::*;
+        let mut options = options();
+        options.dfa_size_limit = 256 << 10;
+        // 伪随机的 0 和 1，右数第 20 位是 1 的判断需要记住之前的 20 个字节，状态数按指数增长
+        let mut seed = 1u32;
+        let bits: String = (0..1 << 20)
+            .map(|i| {
+                seed = seed.wrapping_mul(1103515245).wrapping_add(12345);
+                if i % 80 == 79 {
+                    '\n'
+                } else if seed >> 16 & 1 == 0 {
+                    '0'
+                } else {
+                    '1'
+                }
+            })
+            .collect();
+        let text = haystack_new(bits.as_bytes()).unwrap();
+        let re = regex_new(r"1[01]{20}$", &options).unwrap();
+        let stats = regex_dfa_stats(&re, &text).unwrap();
+        assert!(stats.not_applicable.is_empty());
+        assert_eq!(stats.input_bytes, bits.len() as u64);
+        assert!(stats.thrashing, "清空 {} 次", stats.cache_clears);
+        assert!(stats.suggested_capacity > stats.cache_capacity);
+
+        let re = regex_new(r"1[01]{3}$", &options).unwrap();
+        let stats = regex_dfa_stats(&re, &text).unwrap();
+        assert!(!stats.thrashing, "清空 {} 次", stats.cache_clears);
+        assert_eq!(stats.suggested_capacity, stats.cache_capacity);
+
+        // 遇到非 ASCII 字符时 Unicode 单词边界无法判断，报告不适用而不是出错
+        let text = haystack_new("abc 中文 word".as_bytes()).unwrap();
+        let re = regex_new(r"\bword\b", &options).unwrap();
+        let stats = regex_dfa_stats(&re, &text).unwrap();
+        assert!(!stats.not_applicable.is_empty());
+        assert!(stats.input_bytes < text.as_str().len() as u64);
+        // 纯 ASCII 的输入不受影响
+        let text = haystack_new(b"a word, another word").unwrap();
+        let stats = regex_dfa_stats(&re, &text).unwrap();
+        assert!(stats.not_applicable.is_empty());
+        assert_eq!(stats.matches, 2);
+    }
+
+    #[test]
+    fn pool_map_keeps_order_and_propagates_panics() {
+        super::pool::set_threads(4);
+        let pool = super::pool::global();
+        let items: Vec<usize> = (0..1000).collect();
+        assert_eq!(
+            pool.map(items.clone(), |i| i * 2),
+            items.iter().map(|i| i * 2).collect::<Vec<_>>()
+        );
+        // 嵌套调用不会死锁
+        let nested = pool.map(vec![10, 20, 30], |n| {
+            super::pool::global().map((0..n).collect(), |i| i).len()
+        });
+        assert_eq!(nested, vec![10, 20, 30]);
+        let panicked = std::panic::catch_unwind(|| {
+            pool.map(items.clone(), |i| {
+                if i == 7 {
+                    panic!("任务 7");
+                }
+                i
+            })
+        });
+        assert!(panicked.is_err());
+        // panic 之后线程池仍然可用
+        assert_eq!(pool.map(vec![1, 2, 3], |i| i + 1), vec![2, 3, 4]);
+    }
+
+    #[test]
+    fn pool_survives_set_threads_during_map() {
+        let stop = std::sync::Arc::new(std::sync::atomic::AtomicBool::new(false));
+        let resizer = {
+            let stop = stop.clone();
+            std::thread::spawn(move || {
+                let mut n = 1;
+                while !stop.load(std::sync::atomic::Ordering::Relaxed) {
+                    super::pool::set_threads(n % 4 + 1);
+                    n += 1;
+                    std::thread::yield_now();
+                }
+            })
+        };
+        for round in 0..200 {
+            let items: Vec<u64> = (0..64).map(|i| i + round).collect();
+            let expect: Vec<u64> = items.iter().map(|i| i * i).collect();
+            assert_eq!(super::pool::global().map(items, |i| i * i), expect);
+        }
+        stop.store(true, std::sync::atomic::Ordering::Relaxed);
+        resizer.join().unwrap();
+    }
+
+    #[test]
+    fn parallel_search_matches_sequential() {
+        super::pool::set_threads(4);
+        // 超过切分的最小块大小，确保真的分成多块
+        let text: String = (0..400_000)
+            .map(|i| format!("k{} = v{}  word{}\n", i, i % 7, i % 13))
+            .collect();
+        for pattern in [r"\w+", r"^k\d+", r"$", r"x?", r"\bv3\b", r"(?s)v6.k1"] {
+            let re = super::cppbridge::regex_new(pattern, &options()).unwrap();
+            let s = re.searchable();
+            let parallel: Vec<_> = super::parallel::fold(&s, text.as_bytes(), Vec::new, |v, m| {
+                v.push((m.start(), m.end()))
+            })
+            .into_iter()
+            .flatten()
+            .collect();
+            let sequential: Vec<_> =
+                s.re.find_iter(text.as_bytes())
+                    .map(|m| (m.start(), m.end()))
+                    .collect();
+            assert_eq!(parallel, sequential, "{}", pattern);
+        }
+    }
+
     fn print_tree(tree: &super::tree::Tree<super::parse::TreeItem>, level: usize) {
         println!(
             "{}{} - {} ({},{})",
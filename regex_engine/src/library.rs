@@ -0,0 +1,158 @@
+//! 从文件加载一组命名的正则，在线程池上并行编译。
+//!
+//! 文件为 UTF-8 文本，每行一条：名称和正则之间用空白分隔，与 Grok 的模式文件相同，
+//! 例如 `IPV4 (?:\d{1,3}\.){3}\d{1,3}`。空行和以 `#` 开头的行被忽略。
+//!
+//! 正则中可以用 `%{NAME}` 引用前面的条目，`%{NAME:field}` 把引用的部分作为命名分组 field，
+//! Grok 中表示类型的第三段 `%{NAME:field:int}` 被忽略。只能引用前面的条目，因此不会出现循环引用。
+
+use std::collections::HashMap;
+use std::time::Instant;
+
+use super::cppbridge::{ffi, Regex};
+use regex_syntax::ast::Ast;
+
+pub struct PatternLibrary {
+    pub entries: Vec<ffi::LibraryEntry>,
+    // 与 entries 一一对应，编译失败时为 None。保留 AST，选中时直接生成语法树，不必再解析一遍
+    pub regexes: Vec<Option<(Regex, Ast)>>,
+    // 条目本身有误（缺少正则、引用无法展开），换选项重新编译也没有用
+    pub invalid: Vec<bool>,
+    pub options: ffi::RegexOptions,
+}
+
+struct Definition {
+    name: String,
+    pattern: String, // 已展开全部引用
+    error: Option<String>,
+}
+
+// 展开 `%{NAME}` 和 `%{NAME:field}`，defined 中是前面各条展开后的正则，条目本身有误时为 None。
+// 名称必须以字母或下划线开头，`%{2}` 之类仍是重复次数
+fn expand(pattern: &str, defined: &HashMap<String, Option<String>>) -> anyhow::Result<String> {
+    let mut result = String::with_capacity(pattern.len());
+    let mut rest = pattern;
+    while let Some(i) = rest.find("%{") {
+        result.push_str(&rest[..i]);
+        rest = &rest[i..];
+        let reference = rest[2..].find('}').map(|end| &rest[2..2 + end]);
+        let Some(reference) = reference.filter(|r| {
+            r.starts_with(|c: char| c.is_ascii_alphabetic() || c == '_')
+                && !r.contains(|c: char| c == '{' || c.is_whitespace())
+        }) else {
+            result.push_str("%{");
+            rest = &rest[2..];
+            continue;
+        };
+        let mut parts = reference.splitn(3, ':');
+        let name = parts.next().unwrap_or_default();
+        let field = parts.next().filter(|f| !f.is_empty());
+        let definition = defined
+            .get(name)
+            .ok_or_else(|| anyhow::anyhow!("引用的模式 {} 未定义，只能引用前面的条目", name))?
+            .as_ref()
+            .ok_or_else(|| anyhow::anyhow!("引用的模式 {} 本身有错误", name))?;
+        match field {
+            Some(field) => result.push_str(&format!("(?P<{}>{})", field, definition)),
+            None => result.push_str(&format!("(?:{})", definition)),
+        }
+        rest = &rest[2 + reference.len() + 1..];
+    }
+    result.push_str(rest);
+    Ok(result)
+}
+
+fn parse(text: &str) -> Vec<Definition> {
+    let mut definitions = vec![];
+    let mut defined = HashMap::new();
+    for line in text.lines().map(str::trim) {
+        if line.is_empty() || line.starts_with('#') {
+            continue;
+        }
+        let (name, pattern) = match line.split_once(char::is_whitespace) {
+            Some((name, pattern)) => (name, pattern.trim_start()),
+            None => (line, ""),
+        };
+        let expanded = if pattern.is_empty() {
+            // 否则会得到匹配一切的空正则
+            Err(anyhow::anyhow!("缺少正则"))
+        } else {
+            expand(pattern, &defined)
+        };
+        defined.insert(name.to_string(), expanded.as_ref().ok().cloned());
+        definitions.push(match expanded {
+            Ok(expanded) => Definition {
+                name: name.to_string(),
+                pattern: expanded,
+                error: None,
+            },
+            Err(e) => Definition {
+                name: name.to_string(),
+                pattern: pattern.to_string(),
+                error: Some(e.to_string()),
+            },
+        });
+    }
+    definitions
+}
+
+pub fn load(path: &str, options: &ffi::RegexOptions) -> anyhow::Result<PatternLibrary> {
+    let text = std::fs::read_to_string(path)?;
+    let mut options = options.clone();
+    // 逐个统计编译阶段没有意义，只记录总耗时
+    options.profile = false;
+    let results = super::pool::global().map(parse(&text), |definition| {
+        let Definition {
+            name,
+            pattern,
+            error,
+        } = definition;
+        if let Some(error) = error {
+            let entry = ffi::LibraryEntry {
+                name,
+                pattern,
+                micros: 0,
+                memory: 0,
+                error,
+            };
+            return (entry, None, true);
+        }
+        let now = Instant::now();
+        let compiled = super::compile::compile(&pattern, &options);
+        let micros = now.elapsed().as_micros() as u64;
+        let (regex, memory, error) = match compiled {
+            Ok(compiled) => {
+                let memory = compiled.re.memory_usage() as u64;
+                let ast = compiled.ast.clone();
+                (
+                    Some((Regex::new(&pattern, &options, compiled), ast)),
+                    memory,
+                    String::new(),
+                )
+            }
+            Err(e) => (None, 0, e.to_string()),
+        };
+        let entry = ffi::LibraryEntry {
+            name,
+            pattern,
+            micros,
+            memory,
+            error,
+        };
+        (entry, regex, false)
+    });
+    let mut entries = Vec::with_capacity(results.len());
+    let mut regexes = Vec::with_capacity(results.len());
+    let mut invalid = Vec::with_capacity(results.len());
+    for (entry, regex, bad) in results {
+        entries.push(entry);
+        regexes.push(regex);
+        invalid.push(bad);
+    }
+    Ok(PatternLibrary {
+        entries,
+        regexes,
+        invalid,
+        options,
+    })
+}
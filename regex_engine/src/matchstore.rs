@@ -0,0 +1,186 @@
+//! 把全部匹配写入临时文件，内存占用与匹配数量无关。
+//!
+//! 文件由固定大小的页组成，每页存放若干条定长记录，每条记录依次是各分组的
+//! (u64 起点, u64 终点)，小端序，未参与匹配的分组均为 u64::MAX。
+//! 并行搜索时每个线程填满一页后领取下一个页号写入，文件只追加、不修改，
+//! 页在文件中的位置与匹配顺序无关。页表按匹配顺序记录每页的页号、行数和第一行的序号，
+//! 界面映射文件后按页表定位，分组的值从保存的输入中截取。文件在 MatchStore 释放时删除。
+
+use std::fs::File;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Arc;
+
+use super::cppbridge::ffi::{StoreLayout, StorePage};
+use super::density::Density;
+use super::parallel::{self, Searchable};
+use regex_automata::util::captures::Captures;
+
+// 每页的大小，最后一页可能不满
+const PAGE_SIZE: usize = 64 << 10;
+
+pub struct MatchStore {
+    pub layout: StoreLayout,
+    pub text: Arc<str>,
+}
+
+impl Drop for MatchStore {
+    fn drop(&mut self) {
+        let _ = std::fs::remove_file(&self.layout.path);
+    }
+}
+
+// 一个搜索线程的写入状态
+pub struct Writer<'a> {
+    file: &'a File,
+    next_page: &'a AtomicU64,
+    page_bytes: usize,
+    buf: Vec<u8>,
+    rows: u32,
+    pages: Vec<(u64, u32)>, // 页号、行数
+    error: Option<std::io::Error>,
+    density: &'a Density,
+    counts: Vec<u32>, // 本线程统计的匹配密度
+}
+
+impl Writer<'_> {
+    pub fn push(&mut self, caps: &Captures) {
+        let spans = (0..caps.group_len()).map(|i| {
+            caps.get_group(i)
+                .map_or((u64::MAX, u64::MAX), |s| (s.start as u64, s.end as u64))
+        });
+        self.push_spans(spans);
+    }
+
+    /// 写入一条记录，spans 依次是各分组的起止位置，未参与匹配的分组为 u64::MAX
+    pub fn push_spans(&mut self, spans: impl Iterator<Item = (u64, u64)>) {
+        let record = self.buf.len();
+        for (start, end) in spans {
+            self.buf.extend_from_slice(&start.to_le_bytes());
+            self.buf.extend_from_slice(&end.to_le_bytes());
+        }
+        // 第一个分组即整个匹配
+        let start = u64::from_le_bytes(self.buf[record..record + 8].try_into().unwrap());
+        if let Some(i) = self.density.bucket(start as usize) {
+            self.counts[i] = self.counts[i].saturating_add(1);
+        }
+        self.rows += 1;
+        if self.buf.len() >= self.page_bytes {
+            self.flush();
+        }
+    }
+
+    fn flush(&mut self) {
+        if self.rows == 0 {
+            return;
+        }
+        let index = self.next_page.fetch_add(1, Ordering::Relaxed);
+        if let Err(e) =
+            super::resultfile::write_at(self.file, &self.buf, index * self.page_bytes as u64)
+        {
+            self.error.get_or_insert(e);
+        }
+        self.pages.push((index, self.rows));
+        self.buf.clear();
+        self.rows = 0;
+    }
+}
+
+fn temp_path() -> std::path::PathBuf {
+    static NEXT: AtomicU64 = AtomicU64::new(0);
+    std::env::temp_dir().join(format!(
+        "regex_tool_{}_{}.pages",
+        std::process::id(),
+        NEXT.fetch_add(1, Ordering::Relaxed)
+    ))
+}
+
+pub fn build(
+    s: &Searchable,
+    group_names: &[String],
+    text: Arc<str>,
+    density_buckets: usize,
+) -> anyhow::Result<MatchStore> {
+    build_with(group_names, text, density_buckets, |text, new_writer| {
+        parallel::fold_captures(s, text, new_writer, |w, caps| w.push(caps))
+    })
+}
+
+/// 由调用方按匹配顺序写入一个 Writer。内存中收集的结果超过上限后用它转存到磁盘，
+/// 已收集的结果和之后的匹配接着写入，不必从头再搜索一遍
+pub fn build_sequential(
+    group_names: &[String],
+    text: Arc<str>,
+    density_buckets: usize,
+    fill: impl FnOnce(&mut Writer),
+) -> anyhow::Result<MatchStore> {
+    build_with(group_names, text, density_buckets, |_, new_writer| {
+        let mut w = new_writer();
+        fill(&mut w);
+        vec![w]
+    })
+}
+
+// fill 用给定的函数创建 Writer 并写入全部匹配，返回的 Writer 按匹配顺序排列
+fn build_with<F>(
+    group_names: &[String],
+    text: Arc<str>,
+    density_buckets: usize,
+    fill: F,
+) -> anyhow::Result<MatchStore>
+where
+    F: for<'w> FnOnce(&[u8], &(dyn Fn() -> Writer<'w> + Sync)) -> Vec<Writer<'w>>,
+{
+    let path = temp_path();
+    let file = File::create(&path)?;
+    // 先创建 MatchStore，出错返回时也会删除文件
+    let mut store = MatchStore {
+        layout: StoreLayout {
+            path: path.to_string_lossy().into_owned(),
+            group_names: group_names.to_vec(),
+            rows: 0,
+            page_bytes: 0,
+            pages: vec![],
+            density: vec![],
+        },
+        text,
+    };
+    let density = Density::new(density_buckets, store.text.as_bytes());
+    let record = group_names.len() * 16;
+    let page_bytes = (PAGE_SIZE / record).max(1) * record;
+    let next_page = AtomicU64::new(0);
+    let new_writer = || Writer {
+        file: &file,
+        next_page: &next_page,
+        page_bytes,
+        buf: Vec::with_capacity(page_bytes),
+        rows: 0,
+        pages: vec![],
+        error: None,
+        density: &density,
+        counts: vec![0; density.buckets()],
+    };
+    let mut writers = fill(store.text.as_bytes(), &new_writer);
+    let mut rows = 0u64;
+    let mut counts = vec![0u32; density.buckets()];
+    for w in writers.iter_mut() {
+        for (total, n) in counts.iter_mut().zip(&w.counts) {
+            *total = total.saturating_add(*n);
+        }
+        w.flush();
+        if let Some(e) = w.error.take() {
+            return Err(e.into());
+        }
+        for &(index, n) in &w.pages {
+            store.layout.pages.push(StorePage {
+                index,
+                rows: n,
+                first_row: rows,
+            });
+            rows += n as u64;
+        }
+    }
+    store.layout.rows = rows;
+    store.layout.page_bytes = page_bytes as u64;
+    store.layout.density = counts;
+    Ok(store)
+}
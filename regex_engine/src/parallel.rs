@@ -0,0 +1,149 @@
+//! 把大块输入切分后在线程池上并行搜索。
+//!
+//! 只在换行符之后切分，并且只对不能匹配换行符的正则这样做：
+//! 这时任何匹配都不会跨越切分点，每块单独搜索的结果拼起来与顺序搜索完全相同。
+//! 每块都以整个输入为上下文搜索，`^`、`$`、`\b` 在切分点处的判断不受影响。
+//! 非空的匹配不会在切分点结束，切分点上的空匹配只由后一块负责，拼接时不会重复。
+//! 其他正则退回到单线程搜索。
+
+use regex_automata::{
+    meta,
+    util::{captures::Captures, iter::Searcher},
+    Input, Match,
+};
+use regex_syntax::hir::{self, Hir, HirKind};
+
+// 每块至少这么大，太小的块调度开销比搜索本身还大
+const MIN_CHUNK: usize = 1 << 20;
+
+/// 正则能否匹配到换行符
+pub fn can_match_newline(hir: &Hir) -> bool {
+    hir::visit(hir, NewlineFinder).is_err()
+}
+
+struct NewlineFinder;
+
+impl hir::Visitor for NewlineFinder {
+    type Output = ();
+    type Err = ();
+
+    fn finish(self) -> Result<(), ()> {
+        Ok(())
+    }
+
+    fn visit_pre(&mut self, hir: &Hir) -> Result<(), ()> {
+        let found = match hir.kind() {
+            HirKind::Literal(hir::Literal(bytes)) => bytes.contains(&b'\n'),
+            HirKind::Class(hir::Class::Unicode(class)) => class
+                .ranges()
+                .iter()
+                .any(|r| r.start() <= '\n' && '\n' <= r.end()),
+            HirKind::Class(hir::Class::Bytes(class)) => class
+                .ranges()
+                .iter()
+                .any(|r| r.start() <= b'\n' && b'\n' <= r.end()),
+            _ => false,
+        };
+        if found {
+            Err(())
+        } else {
+            Ok(())
+        }
+    }
+}
+
+/// 参与并行搜索的正则
+pub struct Searchable<'a> {
+    pub id: u64,
+    pub re: &'a meta::Regex,
+    pub line_local: bool, // 不能匹配换行符，可以按行切分
+}
+
+fn split(text: &[u8], parts: usize) -> Vec<std::ops::Range<usize>> {
+    let mut ranges = vec![];
+    let mut start = 0;
+    for i in 1..parts {
+        let target = text.len() / parts * i;
+        if target <= start {
+            continue;
+        }
+        let Some(pos) = text[target..].iter().position(|&b| b == b'\n') else {
+            break;
+        };
+        let end = target + pos + 1;
+        ranges.push(start..end);
+        start = end;
+    }
+    if start < text.len() || ranges.is_empty() {
+        ranges.push(start..text.len());
+    }
+    ranges
+}
+
+// 切分后在线程池上对每块调用 search(块的范围, 匹配起点的上限, 缓存)，按块的顺序返回
+fn chunked<A, F>(s: &Searchable, text: &[u8], search: F) -> Vec<A>
+where
+    A: Send,
+    F: Fn(std::ops::Range<usize>, usize, &mut meta::Cache) -> A + Sync,
+{
+    let pool = super::pool::global();
+    let parts = if s.line_local {
+        (text.len() / MIN_CHUNK).min(pool.threads() * 4).max(1)
+    } else {
+        1
+    };
+    pool.map(split(text, parts), |range| {
+        // 切分点上的空匹配在这一块中被截断了，留给下一块去找
+        let end = if range.end == text.len() {
+            usize::MAX
+        } else {
+            range.end
+        };
+        let _trace = super::trace::scope("search chunk");
+        super::pool::with_cache(s.id, s.re, |cache| search(range, end, cache))
+    })
+}
+
+/// 并行搜索 text，每块的匹配按顺序交给 f 累加到 init() 创建的状态中，按块的顺序返回。
+pub fn fold<A, I, F>(s: &Searchable, text: &[u8], init: I, f: F) -> Vec<A>
+where
+    A: Send,
+    I: Fn() -> A + Sync,
+    F: Fn(&mut A, Match) + Sync,
+{
+    chunked(s, text, |range, end, cache| {
+        let mut it = Searcher::new(Input::new(text).range(range));
+        let mut acc = init();
+        while let Some(m) = it.advance(|input| Ok(s.re.search_with(cache, input))) {
+            if m.start() >= end {
+                break;
+            }
+            f(&mut acc, m);
+        }
+        acc
+    })
+}
+
+/// 与 fold 相同，但同时提取分组，f 收到每个匹配的 Captures
+pub fn fold_captures<A, I, F>(s: &Searchable, text: &[u8], init: I, f: F) -> Vec<A>
+where
+    A: Send,
+    I: Fn() -> A + Sync,
+    F: Fn(&mut A, &Captures) + Sync,
+{
+    chunked(s, text, |range, end, cache| {
+        let mut caps = s.re.create_captures();
+        let mut it = Searcher::new(Input::new(text).range(range));
+        let mut acc = init();
+        while let Some(m) = it.advance(|input| {
+            s.re.search_captures_with(cache, input, &mut caps);
+            Ok(caps.get_match())
+        }) {
+            if m.start() >= end {
+                break;
+            }
+            f(&mut acc, &caps);
+        }
+        acc
+    })
+}
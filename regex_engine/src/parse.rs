@@ -28,8 +28,12 @@ pub fn parse(s: &str, ignore_whitespace: bool) -> anyhow::Result<Tree<TreeItem>>
     builder.ignore_whitespace(ignore_whitespace);
     let mut parser = builder.build();
     let ast = parser.parse(s)?;
+    tree_from_ast(&ast)
+}
+
+pub fn tree_from_ast(ast: &Ast) -> anyhow::Result<Tree<TreeItem>> {
     let visitor = MyAstVisitor::new();
-    let tree = regex_syntax::ast::visit(&ast, visitor)?;
+    let tree = regex_syntax::ast::visit(ast, visitor)?;
     Ok(tree)
 }
 
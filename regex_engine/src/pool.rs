@@ -0,0 +1,345 @@
+//! 引擎内部共用的工作窃取线程池。
+//!
+//! 每个工作线程有自己的任务队列，优先从队尾取自己提交的任务，
+//! 空闲时再从全局队列和其他线程的队头窃取。所有搜索共用同一个线程池，
+//! 同时运行多个搜索时线程总数也不会超过设定值。
+
+use std::cell::{Cell, RefCell};
+use std::collections::{BTreeSet, VecDeque};
+use std::panic::{catch_unwind, resume_unwind, AssertUnwindSafe};
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Condvar, Mutex, OnceLock, RwLock};
+
+use regex_automata::meta;
+
+type Job = Box<dyn FnOnce() + Send + 'static>;
+
+struct Shared {
+    injector: Mutex<VecDeque<Job>>,
+    deques: Vec<Mutex<VecDeque<Job>>>,
+    // 已提交但还没被取走的任务数，可能短暂地偏大，但不会偏小
+    queued: AtomicUsize,
+    sleep: Mutex<()>,
+    wake: Condvar,
+    shutdown: AtomicBool,
+}
+
+thread_local! {
+    // 当前线程所属的线程池和在其中的下标
+    static WORKER: Cell<Option<(usize, usize)>> = const { Cell::new(None) };
+}
+
+impl Shared {
+    fn id(&self) -> usize {
+        self as *const _ as usize
+    }
+
+    fn current_worker(&self) -> Option<usize> {
+        WORKER
+            .with(|w| w.get())
+            .filter(|&(pool, _)| pool == self.id())
+            .map(|(_, index)| index)
+    }
+
+    fn push(&self, job: Job) {
+        self.queued.fetch_add(1, Ordering::SeqCst);
+        match self.current_worker() {
+            Some(i) => self.deques[i].lock().unwrap().push_back(job),
+            None => self.injector.lock().unwrap().push_back(job),
+        }
+        let _guard = self.sleep.lock().unwrap();
+        self.wake.notify_one();
+    }
+
+    fn pop(&self) -> Option<Job> {
+        let index = self.current_worker();
+        let n = self.deques.len();
+        let job = index
+            .and_then(|i| self.deques[i].lock().unwrap().pop_back())
+            .or_else(|| self.injector.lock().unwrap().pop_front())
+            .or_else(|| {
+                let start = index.map_or(0, |i| i + 1);
+                (0..n).find_map(|k| self.deques[(start + k) % n].lock().unwrap().pop_front())
+            });
+        if job.is_some() {
+            self.queued.fetch_sub(1, Ordering::SeqCst);
+        }
+        job
+    }
+
+    fn run_worker(self: Arc<Self>, index: usize) {
+        WORKER.with(|w| w.set(Some((self.id(), index))));
+        loop {
+            if let Some(job) = self.pop() {
+                job();
+                continue;
+            }
+            let guard = self.sleep.lock().unwrap();
+            if self.shutdown.load(Ordering::SeqCst) {
+                break;
+            }
+            // 释放正则后会唤醒空闲的线程，在锁内清理就不会错过
+            CACHES.with(|caches| purge_retired(&mut caches.borrow_mut()));
+            // 提交任务时先增加计数再加锁唤醒，在锁内检查计数就不会错过唤醒
+            if self.queued.load(Ordering::SeqCst) == 0 {
+                drop(self.wake.wait(guard).unwrap());
+            }
+        }
+    }
+}
+
+// 等待一组任务全部完成
+struct Latch {
+    remaining: Mutex<usize>,
+    done: Condvar,
+}
+
+impl Latch {
+    fn add(&self) {
+        *self.remaining.lock().unwrap() += 1;
+    }
+
+    fn set(&self) {
+        let mut remaining = self.remaining.lock().unwrap();
+        *remaining -= 1;
+        if *remaining == 0 {
+            self.done.notify_all();
+        }
+    }
+
+    fn is_set(&self) -> bool {
+        *self.remaining.lock().unwrap() == 0
+    }
+
+    fn wait(&self) {
+        let mut remaining = self.remaining.lock().unwrap();
+        while *remaining > 0 {
+            remaining = self.done.wait(remaining).unwrap();
+        }
+    }
+}
+
+// 离开作用域时等待已提交的任务全部完成，提交途中发生 panic 展开时也一样
+struct WaitGuard<'a>(&'a Latch);
+
+impl Drop for WaitGuard<'_> {
+    fn drop(&mut self) {
+        self.0.wait();
+    }
+}
+
+pub struct Pool {
+    shared: Arc<Shared>,
+    threads: usize,
+}
+
+impl Pool {
+    fn new(threads: usize) -> Self {
+        let shared = Arc::new(Shared {
+            injector: Mutex::new(VecDeque::new()),
+            deques: (0..threads).map(|_| Mutex::new(VecDeque::new())).collect(),
+            queued: AtomicUsize::new(0),
+            sleep: Mutex::new(()),
+            wake: Condvar::new(),
+            shutdown: AtomicBool::new(false),
+        });
+        for i in 0..threads {
+            let shared = shared.clone();
+            std::thread::Builder::new()
+                .name(format!("regex-worker-{}", i))
+                .spawn(move || shared.run_worker(i))
+                .expect("创建工作线程失败");
+        }
+        Self { shared, threads }
+    }
+
+    pub fn threads(&self) -> usize {
+        self.threads
+    }
+
+    /// 并行地对每一项调用 f，按原顺序返回结果。
+    ///
+    /// 在工作线程中嵌套调用时，等待期间会执行队列中的任务，因此不会死锁。
+    /// 其他线程只等待，同时运行的任务不超过线程数。只有一项或只有一个线程时
+    /// 直接在调用线程中执行，这时可能与线程池中其他搜索的任务同时运行。
+    pub fn map<T, R, F>(&self, items: Vec<T>, f: F) -> Vec<R>
+    where
+        T: Send,
+        R: Send,
+        F: Fn(T) -> R + Sync,
+    {
+        if items.len() <= 1 || self.threads <= 1 {
+            return items.into_iter().map(f).collect();
+        }
+        let results = (0..items.len())
+            .map(|_| Mutex::new(None))
+            .collect::<Vec<_>>();
+        let latch = Arc::new(Latch {
+            remaining: Mutex::new(0),
+            done: Condvar::new(),
+        });
+        // 在 results 之后创建，先于 results 和 f 释放
+        let wait = WaitGuard(&latch);
+        for (i, item) in items.into_iter().enumerate() {
+            // 先计数再提交，wait 在正常返回和展开时都会等待计过数的任务完成
+            latch.add();
+            let (f, results, latch) = (&f, &results, latch.clone());
+            let job: Box<dyn FnOnce() + Send + '_> = Box::new(move || {
+                let result = catch_unwind(AssertUnwindSafe(|| f(item)));
+                *results[i].lock().unwrap() = Some(result);
+                latch.set();
+            });
+            // SAFETY: 任务完成之前 wait 不会释放，任务借用的 f 和 results 在此期间一直有效
+            let job: Job = unsafe { std::mem::transmute(job) };
+            self.shared.push(job);
+        }
+        if self.shared.current_worker().is_some() {
+            while !latch.is_set() {
+                match self.shared.pop() {
+                    Some(job) => job(),
+                    None => break,
+                }
+            }
+        }
+        drop(wait);
+        results
+            .into_iter()
+            .map(|i| match i.into_inner().unwrap().unwrap() {
+                Ok(r) => r,
+                Err(e) => resume_unwind(e),
+            })
+            .collect()
+    }
+}
+
+impl Drop for Pool {
+    // 工作线程在取完剩余任务后退出，不在这里等待
+    fn drop(&mut self) {
+        let _guard = self.shared.sleep.lock().unwrap();
+        self.shared.shutdown.store(true, Ordering::SeqCst);
+        self.shared.wake.notify_all();
+    }
+}
+
+fn default_threads() -> usize {
+    std::thread::available_parallelism().map_or(1, |n| n.get())
+}
+
+static GLOBAL: OnceLock<RwLock<Arc<Pool>>> = OnceLock::new();
+
+fn global_lock() -> &'static RwLock<Arc<Pool>> {
+    GLOBAL.get_or_init(|| RwLock::new(Arc::new(Pool::new(default_threads()))))
+}
+
+pub fn global() -> Arc<Pool> {
+    global_lock().read().unwrap().clone()
+}
+
+/// 设置工作线程数量，0 表示使用全部核心。正在运行的搜索继续使用原来的线程池。
+pub fn set_threads(threads: usize) {
+    let threads = if threads == 0 {
+        default_threads()
+    } else {
+        threads
+    };
+    let mut pool = global_lock().write().unwrap();
+    if pool.threads() != threads {
+        *pool = Arc::new(Pool::new(threads));
+    }
+}
+
+static NEXT_REGEX_ID: AtomicU64 = AtomicU64::new(0);
+
+// 还未释放的正则的编号
+static LIVE: Mutex<BTreeSet<u64>> = Mutex::new(BTreeSet::new());
+// 每释放一个正则加一，各线程发现变化后清理已释放的正则的缓存
+static RETIRED: AtomicU64 = AtomicU64::new(0);
+
+/// 正则的唯一编号，用来区分各线程中缓存的搜索状态。
+///
+/// 正则的副本共用同一个 RegexId，最后一个副本释放后，各线程清理为它保留的缓存：
+/// 空闲的工作线程立即被唤醒清理，其他线程在下次调用 with_cache 时清理。
+pub struct RegexId(u64);
+
+impl RegexId {
+    pub fn new() -> Self {
+        let id = NEXT_REGEX_ID.fetch_add(1, Ordering::Relaxed);
+        LIVE.lock().unwrap().insert(id);
+        Self(id)
+    }
+
+    pub fn get(&self) -> u64 {
+        self.0
+    }
+}
+
+impl Drop for RegexId {
+    fn drop(&mut self) {
+        // 先移出再增加计数，看到新计数的线程一定也看得到移出
+        LIVE.lock().unwrap().remove(&self.0);
+        RETIRED.fetch_add(1, Ordering::Release);
+        // 释放正则的线程可能正在 with_cache 中，这时留到下次再清理
+        CACHES.with(|caches| {
+            if let Ok(mut caches) = caches.try_borrow_mut() {
+                purge_retired(&mut caches);
+            }
+        });
+        let shared = global().shared.clone();
+        let _guard = shared.sleep.lock().unwrap();
+        shared.wake.notify_all();
+    }
+}
+
+// 每个线程最多保留几个正则的缓存，懒惰 DFA 的缓存可能很大
+const MAX_CACHES: usize = 4;
+
+struct Caches {
+    retired: u64, // 上次清理时的 RETIRED
+    entries: Vec<(u64, meta::Cache)>,
+}
+
+thread_local! {
+    static CACHES: RefCell<Caches> = const {
+        RefCell::new(Caches {
+            retired: 0,
+            entries: vec![],
+        })
+    };
+}
+
+fn purge_retired(caches: &mut Caches) {
+    let retired = RETIRED.load(Ordering::Acquire);
+    if caches.retired == retired {
+        return;
+    }
+    caches.retired = retired;
+    let live = LIVE.lock().unwrap();
+    caches.entries.retain(|(id, _)| live.contains(id));
+}
+
+/// 使用当前线程为该正则保留的缓存，不与其他线程竞争 meta::Regex 内部的缓存池。
+/// f 中不能再次调用 with_cache。
+pub fn with_cache<R>(id: u64, re: &meta::Regex, f: impl FnOnce(&mut meta::Cache) -> R) -> R {
+    CACHES.with(|caches| {
+        let mut caches = caches.borrow_mut();
+        purge_retired(&mut caches);
+        let entries = &mut caches.entries;
+        let index = match entries.iter().position(|(i, _)| *i == id) {
+            Some(index) => index,
+            None => {
+                if entries.len() >= MAX_CACHES {
+                    entries.remove(0);
+                }
+                entries.push((id, re.create_cache()));
+                entries.len() - 1
+            }
+        };
+        f(&mut entries[index].1)
+    })
+}
+
+/// 当前线程保留了缓存的正则数量
+#[cfg(test)]
+pub fn cached_regexes() -> usize {
+    CACHES.with(|caches| caches.borrow().entries.len())
+}
@@ -0,0 +1,71 @@
+use std::time::Instant;
+
+use super::cppbridge::ffi::{CompilePhase, CompileProfile};
+use regex_syntax::{ast, hir};
+
+/// 统计 AST 和 HIR 的规模。各阶段的耗时由 compile 在实际编译时记录，这里不另外构建 NFA
+/// 或前缀过滤器，分析不会增加编译的开销，各阶段耗时之和就是实际的编译时间。
+pub fn analyze(ast: &ast::Ast, hir: &hir::Hir, profile: &mut CompileProfile) -> anyhow::Result<()> {
+    profile.ast_nodes = ast::visit(ast, AstCounter(0))? as _;
+    let (hir_nodes, class_ranges) = hir::visit(hir, HirCounter::default())?;
+    profile.hir_nodes = hir_nodes as _;
+    profile.class_ranges = class_ranges as _;
+    Ok(())
+}
+
+pub fn timed<T>(profile: &mut CompileProfile, name: &str, f: impl FnOnce() -> T) -> T {
+    let now = Instant::now();
+    let result = f();
+    profile.phases.push(CompilePhase {
+        name: name.into(),
+        micros: now.elapsed().as_micros() as _,
+    });
+    result
+}
+
+struct AstCounter(usize);
+
+impl ast::Visitor for AstCounter {
+    type Output = usize;
+    type Err = std::convert::Infallible;
+
+    fn finish(self) -> Result<Self::Output, Self::Err> {
+        Ok(self.0)
+    }
+
+    fn visit_pre(&mut self, _ast: &ast::Ast) -> Result<(), Self::Err> {
+        self.0 += 1;
+        Ok(())
+    }
+
+    fn visit_class_set_item_pre(&mut self, _ast: &ast::ClassSetItem) -> Result<(), Self::Err> {
+        self.0 += 1;
+        Ok(())
+    }
+}
+
+#[derive(Default)]
+struct HirCounter {
+    nodes: usize,
+    class_ranges: usize,
+}
+
+impl hir::Visitor for HirCounter {
+    type Output = (usize, usize);
+    type Err = std::convert::Infallible;
+
+    fn finish(self) -> Result<Self::Output, Self::Err> {
+        Ok((self.nodes, self.class_ranges))
+    }
+
+    fn visit_pre(&mut self, hir: &hir::Hir) -> Result<(), Self::Err> {
+        self.nodes += 1;
+        if let hir::HirKind::Class(class) = hir.kind() {
+            self.class_ranges += match class {
+                hir::Class::Unicode(c) => c.ranges().len(),
+                hir::Class::Bytes(c) => c.ranges().len(),
+            };
+        }
+        Ok(())
+    }
+}
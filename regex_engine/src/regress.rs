@@ -0,0 +1,192 @@
+//! 性能回归检查，由 `cargo bench --features bench` 运行 benches/regress.rs 调用。
+//!
+//! 用 bench.rs 的语料和测试矩阵运行一遍，与保存的基线逐项比较中位数和 p95。
+//! 中位数变慢超过阈值、匹配数量与基线不同，或基线中的测试本次没有运行，视为回归，
+//! 由 benches/regress.rs 以非零状态退出。
+//! p95 受偶发干扰影响大，超过阈值只提示，不算回归。
+//! 解析等只需几微秒的测试受计时精度和调度影响很大，变慢不足 0.1 ms 时不计。
+//!
+//! 参数（其余参数与 bench.rs 相同）：
+//!   --baseline <PATH>   基线文件，必填
+//!   --save              把本次结果保存为新的基线，不做比较
+//!   --threshold <PCT>   允许变慢的百分比，默认 10
+
+use std::collections::HashMap;
+
+use super::bench;
+
+// 绝对变化小于这个值时不算变慢
+const MIN_DELTA_NS: u64 = 100_000;
+
+struct Baseline {
+    size: usize,
+    results: HashMap<String, Entry>,
+}
+
+struct Entry {
+    matches: u64,
+    median_ns: u64,
+    p95_ns: u64,
+}
+
+// 取出 `"key":value` 中的 value。只需要读 bench::document 写出的文件，
+// 每条结果占一行，名称中不含逗号和引号，不必引入完整的 JSON 解析器
+fn field<'a>(line: &'a str, key: &str) -> Option<&'a str> {
+    let key = format!("\"{}\":", key);
+    let start = line.find(&key)? + key.len();
+    let rest = &line[start..];
+    let end = rest.find([',', '}']).unwrap_or(rest.len());
+    Some(rest[..end].trim_matches('"'))
+}
+
+fn number(line: &str, key: &str) -> anyhow::Result<u64> {
+    field(line, key)
+        .ok_or_else(|| anyhow::anyhow!("基线中缺少 {}：{}", key, line))?
+        .parse()
+        .map_err(|e| anyhow::anyhow!("基线中 {} 无效：{}", key, e))
+}
+
+fn load(path: &str) -> anyhow::Result<Baseline> {
+    let text = std::fs::read_to_string(path)
+        .map_err(|e| anyhow::anyhow!("无法读取基线 {}：{}", path, e))?;
+    let mut lines = text.lines();
+    let header = lines.next().unwrap_or_default();
+    if field(header, "version") != Some("1") {
+        anyhow::bail!("{} 不是基线文件", path);
+    }
+    let mut results = HashMap::new();
+    for line in lines {
+        let Some(name) = field(line, "name") else {
+            continue;
+        };
+        results.insert(
+            name.to_string(),
+            Entry {
+                matches: number(line, "matches")?,
+                median_ns: number(line, "median_ns")?,
+                p95_ns: number(line, "p95_ns")?,
+            },
+        );
+    }
+    Ok(Baseline {
+        size: number(header, "size")? as _,
+        results,
+    })
+}
+
+fn change(now: u64, base: u64) -> f64 {
+    (now as f64 / base.max(1) as f64 - 1.0) * 100.0
+}
+
+fn slower(now: u64, base: u64, threshold: f64) -> bool {
+    now >= base + MIN_DELTA_NS && change(now, base) > threshold
+}
+
+/// 返回回归的项数
+pub fn main() -> anyhow::Result<usize> {
+    let mut baseline_path = None;
+    let mut save = false;
+    let mut threshold = 10.0;
+    let mut rest = vec![];
+    let mut args = std::env::args();
+    while let Some(arg) = args.next() {
+        let mut value = || {
+            args.next()
+                .ok_or_else(|| anyhow::anyhow!("{} 缺少参数", arg))
+        };
+        match arg.as_str() {
+            "--baseline" => baseline_path = Some(value()?),
+            "--save" => save = true,
+            "--threshold" => threshold = value()?.parse::<f64>()?,
+            _ => rest.push(arg),
+        }
+    }
+    let baseline_path =
+        baseline_path.ok_or_else(|| anyhow::anyhow!("需要用 --baseline 指定基线文件"))?;
+    let (config, json) = bench::parse_args(rest.into_iter())?;
+
+    let mut lines = vec![];
+    let mut samples = vec![];
+    bench::print_header();
+    bench::run(&config, |s| {
+        bench::print_sample(s);
+        lines.push(s.to_json());
+        samples.push((s.name(), s.matches, s.median_ns, s.p95_ns));
+    })?;
+    let output = bench::document(&config, &lines);
+    if let Some(path) = json {
+        std::fs::write(path, &output)?;
+    }
+    if save {
+        std::fs::write(&baseline_path, &output)?;
+        eprintln!("已保存基线 {}，共 {} 项", baseline_path, samples.len());
+        return Ok(0);
+    }
+
+    let baseline = load(&baseline_path)?;
+    // 语料大小不同时耗时没有可比性
+    if baseline.size != config.size {
+        anyhow::bail!(
+            "基线的语料大小为 {} MB，本次为 {} MB",
+            baseline.size >> 20,
+            config.size >> 20
+        );
+    }
+    eprintln!();
+    eprintln!(
+        "{:<40} {:>12} {:>12} {:>10} {:>10}",
+        "测试", "基线 ms", "本次 ms", "中位数", "p95"
+    );
+    let mut regressions = 0;
+    for (name, matches, median_ns, p95_ns) in &samples {
+        let Some(base) = baseline.results.get(name) else {
+            eprintln!("{:<40} 基线中没有这一项", name);
+            continue;
+        };
+        let median = change(*median_ns, base.median_ns);
+        let p95 = change(*p95_ns, base.p95_ns);
+        let mut notes = vec![];
+        if *matches != base.matches {
+            notes.push(format!("匹配数量 {} -> {}", base.matches, matches));
+        }
+        if slower(*median_ns, base.median_ns, threshold) {
+            notes.push("中位数回归".to_string());
+        }
+        if !notes.is_empty() {
+            regressions += 1;
+        }
+        if slower(*p95_ns, base.p95_ns, threshold) {
+            notes.push("p95 变慢".to_string());
+        }
+        eprintln!(
+            "{:<40} {:>12.3} {:>12.3} {:>+9.1}% {:>+9.1}%  {}",
+            name,
+            base.median_ns as f64 / 1e6,
+            *median_ns as f64 / 1e6,
+            median,
+            p95,
+            notes.join("，")
+        );
+    }
+    // 基线中有、本次却没有运行的测试，多半是改名或删掉了，不能当作通过
+    let mut missing: Vec<_> = baseline
+        .results
+        .keys()
+        .filter(|name| name.contains(&config.filter))
+        .filter(|name| !samples.iter().any(|s| &s.0 == *name))
+        .collect();
+    missing.sort();
+    for name in &missing {
+        eprintln!("{:<40} 本次没有运行这一项", name);
+    }
+    regressions += missing.len();
+    if regressions > 0 {
+        eprintln!(
+            "{} 项超过 {}% 的阈值、结果改变或缺失",
+            regressions, threshold
+        );
+    } else {
+        eprintln!("没有发现回归");
+    }
+    Ok(regressions)
+}
@@ -0,0 +1,203 @@
+//! 匹配结果的二进制文件格式，可以直接映射到内存中读取，打开时不需要解析。
+//!
+//! 所有整数均为小端序，各段起点按 8 字节对齐：
+//!
+//! ```text
+//! 文件头（64 字节）
+//!   0   magic           [u8; 8]  "RGXMATCH"
+//!   8   version         u32      当前为 2
+//!   12  group_count     u32      分组数量，包括代表整个匹配的第 0 组
+//!   16  match_count     u64
+//!   24  flags           u32      bit 0：包含值堆
+//!   28  reserved        u32
+//!   32  names_offset    u64
+//!   40  records_offset  u64
+//!   48  heap_offset     u64      没有值堆时为 0
+//!   56  heap_len        u64
+//! 分组名
+//!   每个分组依次为 u32 长度 + UTF-8 字节，未命名的分组长度为 0
+//! 匹配记录，每个匹配一条，第 i 条从 records_offset + i * group_count * entry_size 开始
+//!   每个分组依次为 (u64 起点, u64 终点)，未参与匹配时均为 u64::MAX；
+//!   包含值堆时每个分组再跟一个 u64 的值偏移，值为 heap[值偏移..值偏移 + 终点 - 起点]。
+//!   entry_size 为 24（包含值堆）或 16
+//! 值堆
+//!   所有捕获文本首尾相接
+//! ```
+//!
+//! 写入时只搜索一遍：记录按顺序追加，值先写入旁边的临时文件，搜索结束后接在记录之后，
+//! 最后补写文件头中的匹配数量和各段位置。
+
+use std::fs::File;
+
+pub const MAGIC: &[u8; 8] = b"RGXMATCH";
+pub const VERSION: u32 = 2;
+pub const HEADER_LEN: u64 = 64;
+pub const FLAG_VALUES: u32 = 1;
+pub const NO_OFFSET: u64 = u64::MAX;
+
+// 每段先在内存中攒满一块再写入，避免频繁的小块写入
+const BLOCK_SIZE: usize = 1 << 16;
+
+fn align8(n: u64) -> u64 {
+    (n + 7) & !7
+}
+
+#[cfg(unix)]
+pub fn write_at(file: &File, buf: &[u8], offset: u64) -> std::io::Result<()> {
+    std::os::unix::fs::FileExt::write_all_at(file, buf, offset)
+}
+
+#[cfg(windows)]
+pub fn write_at(file: &File, mut buf: &[u8], mut offset: u64) -> std::io::Result<()> {
+    while !buf.is_empty() {
+        let n = std::os::windows::fs::FileExt::seek_write(file, buf, offset)?;
+        buf = &buf[n..];
+        offset += n as u64;
+    }
+    Ok(())
+}
+
+/// 写到文件中固定位置的一段连续区域
+struct Section {
+    offset: u64,
+    buf: Vec<u8>,
+}
+
+impl Section {
+    fn new(offset: u64) -> Self {
+        Self {
+            offset,
+            buf: Vec::with_capacity(BLOCK_SIZE),
+        }
+    }
+
+    fn push(&mut self, file: &File, data: &[u8]) -> std::io::Result<()> {
+        self.buf.extend_from_slice(data);
+        if self.buf.len() >= BLOCK_SIZE {
+            self.flush(file)?;
+        }
+        Ok(())
+    }
+
+    fn flush(&mut self, file: &File) -> std::io::Result<()> {
+        write_at(file, &self.buf, self.offset)?;
+        self.offset += self.buf.len() as u64;
+        self.buf.clear();
+        Ok(())
+    }
+}
+
+// 值堆的临时文件，离开作用域时删除
+struct TempFile {
+    path: String,
+    file: File,
+}
+
+impl Drop for TempFile {
+    fn drop(&mut self) {
+        let _ = std::fs::remove_file(&self.path);
+    }
+}
+
+/// 搜索 text 并把全部匹配写入 path，返回匹配数量。
+///
+/// 边搜索边写入，只搜索一遍，内存占用与匹配数量无关。
+pub fn write(
+    s: &super::parallel::Searchable,
+    text: &str,
+    path: &str,
+    with_values: bool,
+) -> anyhow::Result<u64> {
+    use regex_automata::{util::iter::Searcher, Input, PatternID};
+    use std::io::{Seek, SeekFrom};
+
+    let re = s.re;
+    let names = re
+        .group_info()
+        .pattern_names(PatternID::ZERO)
+        .collect::<Vec<_>>();
+    let group_count = names.len() as u64;
+
+    let mut name_bytes = vec![];
+    for i in names.iter() {
+        let name = i.unwrap_or_default();
+        name_bytes.extend_from_slice(&(name.len() as u32).to_le_bytes());
+        name_bytes.extend_from_slice(name.as_bytes());
+    }
+    let names_offset = HEADER_LEN;
+    let records_offset = align8(names_offset + name_bytes.len() as u64);
+    let record_size = group_count * if with_values { 24 } else { 16 };
+
+    let mut file = File::create(path)?;
+    write_at(&file, &name_bytes, names_offset)?;
+    let heap_file = if with_values {
+        let path = format!("{}.heap", path);
+        let file = File::options()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(true)
+            .open(&path)?;
+        Some(TempFile { path, file })
+    } else {
+        None
+    };
+    let mut records = Section::new(records_offset);
+    let mut heap = Section::new(0);
+    let mut heap_len = 0u64;
+
+    let mut caps = re.create_captures();
+    let mut it = Searcher::new(Input::new(text));
+    let mut match_count = 0u64;
+    while it
+        .advance(|input| {
+            re.search_captures(input, &mut caps);
+            Ok(caps.get_match())
+        })
+        .is_some()
+    {
+        for g in 0..group_count as usize {
+            let (start, end) = match caps.get_group(g) {
+                Some(span) => (span.start as u64, span.end as u64),
+                None => (NO_OFFSET, NO_OFFSET),
+            };
+            records.push(&file, &start.to_le_bytes())?;
+            records.push(&file, &end.to_le_bytes())?;
+            if let Some(heap_file) = &heap_file {
+                records.push(&file, &heap_len.to_le_bytes())?;
+                if start != NO_OFFSET {
+                    let value = &text.as_bytes()[start as usize..end as usize];
+                    heap.push(&heap_file.file, value)?;
+                    heap_len += value.len() as u64;
+                }
+            }
+        }
+        match_count += 1;
+    }
+    records.flush(&file)?;
+
+    let heap_offset = align8(records_offset + match_count * record_size);
+    if let Some(mut heap_file) = heap_file {
+        heap.flush(&heap_file.file)?;
+        heap_file.file.seek(SeekFrom::Start(0))?;
+        file.seek(SeekFrom::Start(heap_offset))?;
+        std::io::copy(&mut heap_file.file, &mut file)?;
+    }
+    // 没有匹配时各段为空，文件仍要覆盖到各段的起点
+    file.set_len(heap_offset + heap_len)?;
+
+    let mut header = Vec::with_capacity(HEADER_LEN as usize);
+    header.extend_from_slice(MAGIC);
+    header.extend_from_slice(&VERSION.to_le_bytes());
+    header.extend_from_slice(&(group_count as u32).to_le_bytes());
+    header.extend_from_slice(&match_count.to_le_bytes());
+    header.extend_from_slice(&(if with_values { FLAG_VALUES } else { 0 }).to_le_bytes());
+    header.extend_from_slice(&0u32.to_le_bytes());
+    header.extend_from_slice(&names_offset.to_le_bytes());
+    header.extend_from_slice(&records_offset.to_le_bytes());
+    header.extend_from_slice(&(if with_values { heap_offset } else { 0 }).to_le_bytes());
+    header.extend_from_slice(&heap_len.to_le_bytes());
+    // 文件头最后写入，写到一半失败的文件不会被当成有效文件
+    write_at(&file, &header, 0)?;
+    Ok(match_count)
+}
@@ -0,0 +1,198 @@
+//! 抽样预览：在文件中均匀地取若干窗口并行搜索，估算整个文件的匹配数量。
+//!
+//! 每个窗口从均匀分布的位置读取固定长度，去掉头尾不完整的行，只统计完整行中开始的匹配；
+//! 窗口前面的半行仍作为上下文，`^`、`\b` 的判断不受影响。能跨行的正则在窗口末尾的匹配会被截断。
+//!
+//! 估算使用比率估计：匹配密度 r = Σ匹配数 / Σ窗口长度，总数估计为 r × 文件长度。
+//! 误差范围为 95% 置信区间的半宽 1.96 × 文件长度 × √V(r)，其中
+//! V(r) = (1 - f) / (n × b̄²) × Σ(cᵢ - r·bᵢ)² / (n - 1)，f 为抽样比例，b̄ 为窗口的平均长度。
+//! 匹配集中在文件局部时窗口之间差异很大，误差范围也随之变大。
+//!
+//! 窗口能覆盖整个文件时改为完整搜索，结果是精确的：把文件按行切成相同数量的连续块并行搜索，
+//! 每块读到行终止符为止，前后相接、互不重叠。能跨行的正则不能按行切分，只在文件不超过一个窗口时完整搜索。
+
+use regex_automata::{util::iter::Searcher, Input};
+
+use super::cppbridge::ffi;
+use super::parallel::Searchable;
+use super::stream::read_at;
+
+// 完整搜索时每块末尾的半行向后读取，每次读这么多
+const LINE_TAIL: usize = 64 << 10;
+
+// 搜索一个窗口，最多保留 limit 个匹配的分组，其余只计数。
+// whole_lines 时把末尾的半行读完，窗口结束在 offset + size 处或之后的第一个行首
+#[allow(clippy::too_many_arguments)]
+fn search_window(
+    s: &Searchable,
+    terminator: u8,
+    file: &std::fs::File,
+    file_len: u64,
+    offset: u64,
+    size: usize,
+    whole_lines: bool,
+    limit: usize,
+) -> std::io::Result<ffi::SampleWindow> {
+    let _trace = super::trace::scope("sample window");
+    let mut buf = vec![0; size];
+    let n = read_at(file, &mut buf, offset)?;
+    buf.truncate(n);
+    if whole_lines && n == size && buf.last() != Some(&terminator) {
+        // 匹配位置用 u32 表示，超长的行在这里截断
+        while buf.len() < u32::MAX as usize {
+            let at = buf.len();
+            buf.resize(at + LINE_TAIL, 0);
+            let m = read_at(file, &mut buf[at..], offset + at as u64)?;
+            buf.truncate(at + m);
+            if let Some(i) = buf[at..].iter().position(|&b| b == terminator) {
+                buf.truncate(at + i + 1);
+                break;
+            }
+            if m < LINE_TAIL {
+                break;
+            }
+        }
+    }
+    let n = buf.len();
+    // 第一个行终止符之前的半行属于上一个窗口；没有读到文件末尾时，最后一个行终止符之后的半行也不完整
+    let start = if offset == 0 {
+        0
+    } else {
+        buf.iter()
+            .position(|&b| b == terminator)
+            .map_or(n, |i| i + 1)
+    };
+    let end = if offset + n as u64 >= file_len {
+        n
+    } else {
+        buf.iter()
+            .rposition(|&b| b == terminator)
+            .map_or(0, |i| i + 1)
+    };
+    let mut window = ffi::SampleWindow {
+        offset,
+        len: 0,
+        count: 0,
+        matches: vec![],
+    };
+    if start >= end {
+        // 单行比窗口还长，这个窗口中没有完整的行
+        return Ok(window);
+    }
+    window.len = (end - start) as u64;
+    let re = s.re;
+    super::pool::with_cache(s.id, re, |cache| {
+        let mut caps = re.create_captures();
+        let mut it = Searcher::new(Input::new(&buf[..end]).range(start..end));
+        loop {
+            let collect = window.matches.len() < limit;
+            let m = if collect {
+                it.advance(|input| {
+                    re.search_captures_with(cache, input, &mut caps);
+                    Ok(caps.get_match())
+                })
+            } else {
+                it.advance(|input| Ok(re.search_with(cache, input)))
+            };
+            if m.is_none() {
+                break;
+            }
+            if collect {
+                window.matches.push(ffi::Match {
+                    groups: super::cppbridge::conv_groups(&caps, &buf),
+                });
+            }
+            window.count += 1;
+        }
+    });
+    Ok(window)
+}
+
+pub fn sample(
+    s: &Searchable,
+    terminator: u8,
+    file: &std::fs::File,
+    windows: usize,
+    window_size: usize,
+    limit: usize,
+) -> anyhow::Result<ffi::SampleResult> {
+    let file_len = file.metadata()?.len();
+    let windows = windows.max(1);
+    // 匹配位置用 u32 表示
+    let window_size = window_size.clamp(4096, u32::MAX as usize);
+    let exact = if s.line_local {
+        file_len <= (windows as u64).saturating_mul(window_size as u64)
+    } else {
+        file_len <= window_size as u64
+    };
+    // 每个窗口的起点和读取长度。完整搜索时第 i 块从 file_len × i / windows 之后的第一个行首开始，
+    // 多读前面一个字节，以便判断起点本身是不是行首
+    let ranges: Vec<(u64, usize)> = if exact {
+        // 小文件不必切得太碎，各块多读的前一个字节也就不会落在文件开头
+        let chunks = if s.line_local {
+            (windows as u64).min(file_len / 4096).max(1)
+        } else {
+            1
+        };
+        let bounds: Vec<u64> = (0..=chunks).map(|i| file_len * i / chunks).collect();
+        bounds
+            .windows(2)
+            .map(|b| {
+                let offset = b[0].saturating_sub(1);
+                (offset, (b[1] - offset) as usize)
+            })
+            .collect()
+    } else {
+        (0..windows as u64)
+            .map(|i| {
+                let offset = (file_len - window_size as u64) / (windows as u64 - 1).max(1) * i;
+                (offset, window_size)
+            })
+            .collect()
+    };
+    let results = super::pool::global().map(ranges, |(offset, size)| {
+        search_window(s, terminator, file, file_len, offset, size, exact, limit)
+    });
+    let windows = results.into_iter().collect::<Result<Vec<_>, _>>()?;
+
+    let sampled: u64 = windows.iter().map(|w| w.len).sum();
+    let total: u64 = windows.iter().map(|w| w.count).sum();
+    if exact {
+        return Ok(ffi::SampleResult {
+            file_len,
+            sampled,
+            estimate: total as f64,
+            margin: 0.0,
+            exact,
+            windows,
+        });
+    }
+    if sampled == 0 {
+        anyhow::bail!("抽样的窗口中没有完整的行，请增大窗口");
+    }
+    // 没有完整行的窗口不参与估算
+    let used: Vec<_> = windows.iter().filter(|w| w.len > 0).collect();
+    let n = used.len() as f64;
+    let r = total as f64 / sampled as f64;
+    let margin = if used.len() < 2 {
+        f64::INFINITY
+    } else {
+        let mean_len = sampled as f64 / n;
+        let f = sampled as f64 / file_len as f64;
+        let s2 = used
+            .iter()
+            .map(|w| (w.count as f64 - r * w.len as f64).powi(2))
+            .sum::<f64>()
+            / (n - 1.0);
+        let var = (1.0 - f).max(0.0) * s2 / (n * mean_len * mean_len);
+        1.96 * file_len as f64 * var.sqrt()
+    };
+    Ok(ffi::SampleResult {
+        file_len,
+        sampled,
+        estimate: r * file_len as f64,
+        margin,
+        exact,
+        windows,
+    })
+}
@@ -0,0 +1,181 @@
+use std::io::{ErrorKind, Read, Write};
+
+// 每块前面保留的上一块末尾的字节数，足够判断前一个字符（UTF-8 最长 4 字节），
+// 块开头不会被当作输入的开头，`^`、`\A`、`\b` 的结果不随块大小变化
+const CONTEXT: usize = 4;
+
+/// next_chunk 返回的一块输入
+pub struct Chunk<'a> {
+    /// haystack[0] 在流中的偏移
+    pub offset: u64,
+    /// 块本身以及前后的上下文，搜索时用作整个输入
+    pub haystack: &'a [u8],
+    /// 块在 haystack 中的范围，只报告在这个范围内开始的匹配
+    pub range: std::ops::Range<usize>,
+    /// 流中的最后一块，块末尾的空匹配只由最后一块报告，其余的留给下一块
+    pub last: bool,
+}
+
+/// 固定大小的滚动缓冲区，按整行切分输入流。
+///
+/// 每次返回的块都以行终止符（默认为换行符）结尾（流结束时除外），未读完的半行留在缓冲区头部，
+/// 与下一次读入的数据拼接，因此不跨行的匹配不会被块边界截断。
+/// 块前面带有上一块的最后几个字节，后面尽量带上下一块的开头，用作 look-around 的上下文。
+/// 单行长度超过缓冲区时只能强制切分，跨越该切分点的匹配会丢失。
+pub struct LineBuffer<R: Read> {
+    reader: R,
+    buf: Vec<u8>,
+    len: usize,
+    start: usize,
+    consumed: usize,
+    offset: u64,
+    eof: bool,
+    terminator: u8,
+}
+
+impl<R: Read> LineBuffer<R> {
+    pub fn new(reader: R, capacity: usize) -> Self {
+        Self {
+            reader,
+            buf: vec![0; capacity.max(CONTEXT + 1)],
+            len: 0,
+            start: 0,
+            consumed: 0,
+            offset: 0,
+            eof: false,
+            terminator: b'\n',
+        }
+    }
+
+    /// 按其他字节切分记录，如 NUL 分隔的数据
+    pub fn terminator(mut self, terminator: u8) -> Self {
+        self.terminator = terminator;
+        self
+    }
+
+    fn fill(&mut self) -> std::io::Result<()> {
+        loop {
+            match self.reader.read(&mut self.buf[self.len..]) {
+                Ok(0) => self.eof = true,
+                Ok(n) => self.len += n,
+                Err(e) if e.kind() == ErrorKind::Interrupted => continue,
+                Err(e) => return Err(e),
+            }
+            return Ok(());
+        }
+    }
+
+    /// 读取下一块完整的行，流结束时返回 None。
+    pub fn next_chunk(&mut self) -> std::io::Result<Option<Chunk<'_>>> {
+        // 丢弃上一次返回的块，只保留最后几个字节作为上下文，把剩余的半行移到缓冲区头部
+        if self.consumed > 0 {
+            let keep = self.consumed.min(CONTEXT);
+            let drop = self.consumed - keep;
+            self.buf.copy_within(drop..self.len, 0);
+            self.len -= drop;
+            self.offset += drop as u64;
+            self.start = keep;
+            self.consumed = 0;
+        }
+        let mut scanned = self.start;
+        let mut found = None;
+        let end = loop {
+            if let Some(pos) = self.buf[scanned..self.len]
+                .iter()
+                .rposition(|&b| b == self.terminator)
+            {
+                found = Some(scanned + pos + 1);
+            }
+            if self.eof {
+                break self.len;
+            }
+            // 块后面至少还有一个字节时，`$`、`\b` 才能看到块之后的内容
+            if let Some(end) = found.filter(|&end| end < self.len) {
+                break end;
+            }
+            if self.len == self.buf.len() {
+                // 单行超过缓冲区大小，只能强制切分
+                break found.unwrap_or(self.len);
+            }
+            scanned = self.len;
+            self.fill()?;
+        };
+        if end == self.start {
+            return Ok(None);
+        }
+        self.consumed = end;
+        Ok(Some(Chunk {
+            offset: self.offset,
+            haystack: &self.buf[..self.len],
+            range: self.start..end,
+            last: self.eof && end == self.len,
+        }))
+    }
+}
+
+#[cfg(unix)]
+pub fn fd_file(fd: i32) -> std::io::Result<FdFile> {
+    use std::os::fd::FromRawFd;
+    if fd < 0 {
+        return Err(std::io::Error::from(ErrorKind::InvalidInput));
+    }
+    let file = unsafe { std::fs::File::from_raw_fd(fd) };
+    Ok(FdFile(std::mem::ManuallyDrop::new(file)))
+}
+
+#[cfg(windows)]
+pub fn fd_file(fd: i32) -> std::io::Result<FdFile> {
+    use std::os::windows::io::FromRawHandle;
+    extern "C" {
+        fn _get_osfhandle(fd: i32) -> isize;
+    }
+    let handle = unsafe { _get_osfhandle(fd) };
+    if handle == -1 {
+        return Err(std::io::Error::from(ErrorKind::InvalidInput));
+    }
+    let file = unsafe { std::fs::File::from_raw_handle(handle as _) };
+    Ok(FdFile(std::mem::ManuallyDrop::new(file)))
+}
+
+/// 借用调用方的文件描述符，不负责关闭
+pub struct FdFile(std::mem::ManuallyDrop<std::fs::File>);
+
+impl FdFile {
+    pub fn file(&self) -> &std::fs::File {
+        &self.0
+    }
+}
+
+/// 从 offset 处读取，直到填满 buf 或到达文件末尾，返回读到的字节数。不改变文件的读写位置，可以多线程同时读
+pub fn read_at(file: &std::fs::File, buf: &mut [u8], offset: u64) -> std::io::Result<usize> {
+    let mut n = 0;
+    while n < buf.len() {
+        #[cfg(unix)]
+        let r = std::os::unix::fs::FileExt::read_at(file, &mut buf[n..], offset + n as u64);
+        #[cfg(windows)]
+        let r = std::os::windows::fs::FileExt::seek_read(file, &mut buf[n..], offset + n as u64);
+        match r {
+            Ok(0) => break,
+            Ok(k) => n += k,
+            Err(e) if e.kind() == ErrorKind::Interrupted => {}
+            Err(e) => return Err(e),
+        }
+    }
+    Ok(n)
+}
+
+impl Read for FdFile {
+    fn read(&mut self, buf: &mut [u8]) -> std::io::Result<usize> {
+        (&*self.0).read(buf)
+    }
+}
+
+impl Write for FdFile {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        (&*self.0).write(buf)
+    }
+
+    fn flush(&mut self) -> std::io::Result<()> {
+        (&*self.0).flush()
+    }
+}
@@ -0,0 +1,119 @@
+use regex_automata::util::captures::{Captures, GroupInfo};
+use regex_automata::PatternID;
+
+#[derive(Clone)]
+enum Segment {
+    // 在 literals 中的范围
+    Literal(usize, usize),
+    Group(usize),
+}
+
+/// 预先编译好的替换模板，语法与 regex 库的 replace_all 相同：
+/// `$1`、`$name`、`${name}` 引用分组，`$$` 表示 `$` 本身。
+///
+/// 与 regex 库不同的是，引用不存在的分组会在编译时报错，而不是静默替换为空。
+#[derive(Clone)]
+pub struct Template {
+    literals: String,
+    segments: Vec<Segment>,
+}
+
+impl Template {
+    pub fn new(rep: &str, groups: &GroupInfo) -> anyhow::Result<Self> {
+        let mut template = Self {
+            literals: String::new(),
+            segments: vec![],
+        };
+        let mut rest = rep;
+        while let Some(i) = rest.find('$') {
+            template.push_literal(&rest[..i]);
+            rest = &rest[i..];
+            if rest.as_bytes().get(1) == Some(&b'$') {
+                template.push_literal("$");
+                rest = &rest[2..];
+                continue;
+            }
+            let Some((name, len)) = find_group_ref(rest) else {
+                template.push_literal("$");
+                rest = &rest[1..];
+                continue;
+            };
+            let index = match name.parse::<usize>() {
+                Ok(i) if i < groups.group_len(PatternID::ZERO) => i,
+                Ok(_) => anyhow::bail!("分组 ${} 不存在", name),
+                Err(_) => groups
+                    .to_index(PatternID::ZERO, name)
+                    .ok_or_else(|| anyhow::anyhow!("分组 {} 不存在", name))?,
+            };
+            template.segments.push(Segment::Group(index));
+            rest = &rest[len..];
+        }
+        template.push_literal(rest);
+        Ok(template)
+    }
+
+    fn push_literal(&mut self, s: &str) {
+        if s.is_empty() {
+            return;
+        }
+        let start = self.literals.len();
+        self.literals.push_str(s);
+        // 相邻的字面量合并成一段
+        if let Some(Segment::Literal(_, end)) = self.segments.last_mut() {
+            if *end == start {
+                *end = self.literals.len();
+                return;
+            }
+        }
+        self.segments
+            .push(Segment::Literal(start, self.literals.len()));
+    }
+
+    pub fn expand(&self, caps: &Captures, text: &str, dst: &mut String) {
+        for i in self.pieces(caps) {
+            match i {
+                Piece::Literal(s) => dst.push_str(s),
+                Piece::Group(range) => dst.push_str(&text[range]),
+            }
+        }
+    }
+
+    // 输入流不保证是合法的 UTF-8，按字节展开
+    pub fn expand_bytes(&self, caps: &Captures, text: &[u8], dst: &mut Vec<u8>) {
+        for i in self.pieces(caps) {
+            match i {
+                Piece::Literal(s) => dst.extend_from_slice(s.as_bytes()),
+                Piece::Group(range) => dst.extend_from_slice(&text[range]),
+            }
+        }
+    }
+
+    fn pieces<'a>(&'a self, caps: &'a Captures) -> impl Iterator<Item = Piece<'a>> + 'a {
+        self.segments.iter().filter_map(|i| match *i {
+            Segment::Literal(start, end) => Some(Piece::Literal(&self.literals[start..end])),
+            Segment::Group(index) => caps.get_group(index).map(|span| Piece::Group(span.range())),
+        })
+    }
+}
+
+enum Piece<'a> {
+    Literal(&'a str),
+    Group(std::ops::Range<usize>),
+}
+
+// 返回分组名和整个引用（含 `$`）的长度
+fn find_group_ref(s: &str) -> Option<(&str, usize)> {
+    let rest = &s[1..];
+    if let Some(braced) = rest.strip_prefix('{') {
+        let end = braced.find('}')?;
+        return Some((&braced[..end], end + 3));
+    }
+    let end = rest
+        .bytes()
+        .position(|b| !(b.is_ascii_alphanumeric() || b == b'_'))
+        .unwrap_or(rest.len());
+    if end == 0 {
+        return None;
+    }
+    Some((&rest[..end], end + 1))
+}
@@ -0,0 +1,138 @@
+//! 以 Chrome trace 格式记录各阶段的耗时，输出文件可以在 chrome://tracing 或 Perfetto 中打开。
+//!
+//! 环境变量 REGEX_TOOL_TRACE 设为输出文件路径时开启，未设置时计时器只检查一次开关，
+//! 不读时钟也不分配内存。界面一侧通过 cppbridge 中的 trace_* 函数记录，两边共用同一个时间起点。
+
+use std::io::Write;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Mutex, OnceLock};
+use std::time::Instant;
+
+// 超过这么多事件后不再记录，避免长时间运行时无限增长
+const MAX_EVENTS: usize = 1 << 20;
+
+struct Event {
+    name: String,
+    cat: &'static str,
+    tid: u64,
+    start_ns: u64,
+    dur_ns: u64,
+}
+
+struct Tracer {
+    path: String,
+    start: Instant,
+    events: Mutex<Vec<Event>>,
+}
+
+static TRACER: OnceLock<Option<Tracer>> = OnceLock::new();
+
+fn tracer() -> Option<&'static Tracer> {
+    TRACER
+        .get_or_init(|| {
+            let path = std::env::var("REGEX_TOOL_TRACE").ok()?;
+            (!path.is_empty()).then(|| Tracer {
+                path,
+                start: Instant::now(),
+                events: Mutex::new(vec![]),
+            })
+        })
+        .as_ref()
+}
+
+// trace 中的线程号，按首次记录的顺序分配
+fn thread_id() -> u64 {
+    static NEXT: AtomicU64 = AtomicU64::new(1);
+    thread_local! {
+        static ID: u64 = NEXT.fetch_add(1, Ordering::Relaxed);
+    }
+    ID.with(|id| *id)
+}
+
+pub fn enabled() -> bool {
+    tracer().is_some()
+}
+
+/// 从开始记录到现在的纳秒数，未开启时为 0
+pub fn now() -> u64 {
+    tracer().map_or(0, |t| t.start.elapsed().as_nanos() as u64)
+}
+
+/// 记录一段从 start_ns 开始、到现在结束的事件
+pub fn record(cat: &'static str, name: &str, start_ns: u64) {
+    let Some(t) = tracer() else {
+        return;
+    };
+    let end = t.start.elapsed().as_nanos() as u64;
+    let mut events = t.events.lock().unwrap();
+    if events.len() < MAX_EVENTS {
+        events.push(Event {
+            name: name.to_string(),
+            cat,
+            tid: thread_id(),
+            start_ns,
+            dur_ns: end.saturating_sub(start_ns),
+        });
+    }
+}
+
+/// 作用域计时器，离开作用域时记录一个事件
+pub struct Scope {
+    name: &'static str,
+    start_ns: Option<u64>,
+}
+
+impl Drop for Scope {
+    fn drop(&mut self) {
+        if let Some(start_ns) = self.start_ns {
+            record("engine", self.name, start_ns);
+        }
+    }
+}
+
+pub fn scope(name: &'static str) -> Scope {
+    Scope {
+        name,
+        start_ns: enabled().then(now),
+    }
+}
+
+// 转成带引号的 JSON 字符串，基准测试的输出也用它
+pub(crate) fn json_str(s: &str) -> String {
+    let mut out = String::from("\"");
+    for c in s.chars() {
+        match c {
+            '"' => out.push_str("\\\""),
+            '\\' => out.push_str("\\\\"),
+            c if (c as u32) < 0x20 => out.push_str(&format!("\\u{:04x}", c as u32)),
+            c => out.push(c),
+        }
+    }
+    out.push('"');
+    out
+}
+
+/// 把目前记录的全部事件写入输出文件，每次都重写整个文件
+pub fn flush() -> anyhow::Result<()> {
+    let Some(t) = tracer() else {
+        return Ok(());
+    };
+    let events = t.events.lock().unwrap();
+    let mut f = std::io::BufWriter::new(std::fs::File::create(&t.path)?);
+    writeln!(f, "{{\"traceEvents\":[")?;
+    for (i, e) in events.iter().enumerate() {
+        writeln!(
+            f,
+            "{{\"name\":{},\"cat\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3},\"dur\":{:.3}}}{}",
+            json_str(&e.name),
+            e.cat,
+            e.tid,
+            e.start_ns as f64 / 1000.0,
+            e.dur_ns as f64 / 1000.0,
+            if i + 1 < events.len() { "," } else { "" }
+        )?;
+    }
+    writeln!(f, "],\"displayTimeUnit\":\"ms\"}}")?;
+    f.flush()?;
+    Ok(())
+}
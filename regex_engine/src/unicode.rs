@@ -0,0 +1,69 @@
+//! 比较同一个正则在 Unicode 模式和 ASCII 模式下的规模与速度。
+//!
+//! `\w`、`\d` 等类在 Unicode 模式下包含几百个范围，编译成 UTF-8 自动机后状态数远多于
+//! ASCII 版本，懒惰 DFA 也更容易反复清空缓存。输入只含 ASCII 时两者结果相同。
+
+use std::time::Instant;
+
+use super::cppbridge::ffi::{RegexOptions, UnicodeAdvice};
+use regex_automata::nfa::thompson;
+
+// 只在输入开头的这么多字节上测速
+const SAMPLE_SIZE: usize = 16 << 20;
+
+#[derive(Default)]
+struct Measure {
+    nfa_states: u32,
+    nfa_memory: u64,
+    micros: u64,
+    matches: u64,
+}
+
+fn measure(pattern: &str, options: &RegexOptions, sample: &[u8]) -> anyhow::Result<Measure> {
+    let compiled = super::compile::compile(pattern, options)?;
+    let nfa = thompson::Compiler::new()
+        .configure(thompson::Config::new().nfa_size_limit(Some(10 * (1 << 20))))
+        .build_from_hir(&compiled.hir)?;
+    let now = Instant::now();
+    let matches = compiled.re.find_iter(sample).count() as u64;
+    Ok(Measure {
+        nfa_states: nfa.states().len() as _,
+        nfa_memory: nfa.memory_usage() as _,
+        micros: now.elapsed().as_micros() as _,
+        matches,
+    })
+}
+
+pub fn advise(pattern: &str, options: &RegexOptions, text: &[u8]) -> anyhow::Result<UnicodeAdvice> {
+    // 在字符边界处截断，只需检查取样部分是否为有效的 UTF-8
+    let mut end = text.len().min(SAMPLE_SIZE);
+    while end < text.len() && end > 0 && text[end] & 0xC0 == 0x80 {
+        end -= 1;
+    }
+    let sample = std::str::from_utf8(&text[..end])
+        .map_err(|e| anyhow::anyhow!("输入不是有效的 UTF-8，位置 {}", e.valid_up_to()))?
+        .as_bytes();
+    let mut options = options.clone();
+    options.profile = false;
+
+    options.unicode = true;
+    let unicode = measure(pattern, &options, sample)?;
+    options.unicode = false;
+    // ASCII 模式下 `.`、`[^a]` 等可以匹配非 UTF-8 的字节，这样的正则无法编译
+    let (ascii, ascii_error) = match measure(pattern, &options, sample) {
+        Ok(m) => (m, String::new()),
+        Err(e) => (Measure::default(), e.to_string()),
+    };
+    Ok(UnicodeAdvice {
+        sampled_bytes: sample.len() as _,
+        unicode_nfa_states: unicode.nfa_states,
+        unicode_nfa_memory: unicode.nfa_memory,
+        unicode_micros: unicode.micros,
+        unicode_matches: unicode.matches,
+        ascii_nfa_states: ascii.nfa_states,
+        ascii_nfa_memory: ascii.nfa_memory,
+        ascii_micros: ascii.micros,
+        ascii_matches: ascii.matches,
+        ascii_error,
+    })
+}
@@ -1,6 +1,87 @@
 ﻿#include "pch.h"
 #include "mainwindow.h"
 
+// 把升序排列的 UTF-8 偏移一次性转换为 UTF-16 偏移
+static std::vector<int> utf8ToUtf16(const char *utf8, size_t size, const std::vector<uint32_t> &offsets)
+{
+    std::vector<int> result;
+    result.reserve(offsets.size());
+    size_t pos = 0;
+    int units = 0;
+    for (auto offset : offsets)
+    {
+        for (; pos < offset && pos < size; pos++)
+        {
+            auto c = static_cast<uint8_t>(utf8[pos]);
+            if ((c & 0xC0) != 0x80)
+            {
+                // 4 字节的 UTF-8 序列对应一个代理对
+                units += c >= 0xF0 ? 2 : 1;
+            }
+        }
+        result.push_back(units);
+    }
+    return result;
+}
+
+// 按长度传给 Rust，不依赖结尾的 NUL，中间的 NUL 也不会截断
+static rust::Str toStr(const QByteArray &utf8)
+{
+    return rust::Str(utf8.data(), utf8.size());
+}
+
+static rust::Slice<const uint8_t> toBytes(const QByteArray &utf8)
+{
+    return rust::Slice<const uint8_t>(reinterpret_cast<const uint8_t *>(utf8.data()), utf8.size());
+}
+
+// 表格中每个单元格除文本以外的大致开销：QStandardItem 及其中的文本、提示、位置三项数据
+static const size_t table_cell_bytes = 256;
+
+// 文件搜索最多显示的行数，超过后只计数，表格占用的内存不随文件大小增长
+static const size_t max_file_rows = 100000;
+
+// 打开的 CSV 文件，reader 读取期间 stream 必须一直有效
+struct CsvFile
+{
+    std::ifstream stream;
+    std::unique_ptr<csv::CSVReader> reader;
+};
+
+static std::shared_ptr<CsvFile> openCsv(const QString &filename)
+{
+    auto file = std::make_shared<CsvFile>();
+#ifdef _WIN32
+    // mio 按 ANSI 代码页解释窄字符路径，非 ASCII 的路径无法打开。改用宽字符路径打开流，
+    // 流不会自动猜测分隔符和标题行，用文件开头手动猜测
+    QFile f(filename);
+    if (!f.open(QIODevice::ReadOnly))
+    {
+        throw std::runtime_error(QString::fromWCharArray(L"打开文件失败").toUtf8().data());
+    }
+    auto head = f.read(500000);
+    auto guess = csv::internals::_guess_format(csv::string_view(head.data(), head.size()));
+    csv::CSVFormat format;
+    format.delimiter(guess.delim).quote('"').header_row(guess.header_row);
+    file->stream.open(std::filesystem::path(filename.toStdWString()), std::ios::binary);
+    if (!file->stream)
+    {
+        throw std::runtime_error(QString::fromWCharArray(L"打开文件失败").toUtf8().data());
+    }
+    file->reader = std::make_unique<csv::CSVReader>(file->stream, format);
+#else
+    // CSVReader 在后台线程中分块映射文件并解析，整个文件不会读入内存
+    file->reader = std::make_unique<csv::CSVReader>(QFile::encodeName(filename).toStdString());
+#endif
+    return file;
+}
+
+static QString costRating(uint8_t rating)
+{
+    const wchar_t *names[] = {L"低", L"中", L"高", L"很高"};
+    return QString::fromWCharArray(names[std::min<uint8_t>(rating, 3)]);
+}
+
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
 {
     statusbar = new QStatusBar();
@@ -9,11 +90,37 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     auto tb = new QToolBar();
     auto exec_btn = new QPushButton(QString::fromWCharArray(L"运行"));
     tb->addWidget(exec_btn);
+    auto stream_btn = new QPushButton(QString::fromWCharArray(L"搜索文件"));
+    stream_btn->setToolTip(QString::fromWCharArray(L"逐块读取文件并搜索，不载入到输入框\n替换模式下把替换结果写入另一个文件"));
+    tb->addWidget(stream_btn);
+    auto sample_btn = new QPushButton(QString::fromWCharArray(L"抽样预览"));
+    sample_btn->setToolTip(QString::fromWCharArray(L"在文件中均匀地取若干窗口并行搜索，只显示其中的部分匹配\n并估算整个文件的匹配数量，适合先在大文件上试验正则"));
+    tb->addWidget(sample_btn);
+    auto csv_btn = new QPushButton(QString::fromWCharArray(L"搜索 CSV"));
+    csv_btn->setToolTip(QString::fromWCharArray(L"逐行读取 CSV 文件，只搜索选定的列，显示有匹配的行\n文件不载入到输入框"));
+    tb->addWidget(csv_btn);
+    stop_btn = new QPushButton(QString::fromWCharArray(L"停止"));
+    stop_btn->setToolTip(QString::fromWCharArray(L"停止正在进行的文件搜索"));
+    stop_btn->setEnabled(false);
+    tb->addWidget(stop_btn);
+    auto save_btn = new QPushButton(QString::fromWCharArray(L"保存结果"));
+    save_btn->setToolTip(QString::fromWCharArray(L"把全部匹配写入二进制结果文件，之后可以直接打开，不需要重新搜索"));
+    tb->addWidget(save_btn);
+    auto open_btn = new QPushButton(QString::fromWCharArray(L"打开结果"));
+    tb->addWidget(open_btn);
     combo = new QComboBox();
     combo->addItem(QString::fromWCharArray(L"匹配"));
     combo->addItem(QString::fromWCharArray(L"替换"));
     combo->addItem(QString::fromWCharArray(L"分割"));
+    combo->addItem(QString::fromWCharArray(L"DFA 分析"));
     tb->addWidget(combo);
+    library_btn = new QPushButton(QString::fromWCharArray(L"模式库"));
+    library_btn->setToolTip(QString::fromWCharArray(L"加载模式库文件，每行为名称和正则，以空白分隔\n全部正则在后台并行编译，之后可以直接选用"));
+    tb->addWidget(library_btn);
+    library_combo = new QComboBox();
+    library_combo->setMinimumContentsLength(16);
+    library_combo->setEnabled(false);
+    tb->addWidget(library_combo);
     addToolBar(tb);
 
     auto tb2 = new QToolBar();
@@ -31,6 +138,63 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     dot_matches_new_line_check->setText(QString::fromWCharArray(L"单行模式"));
     dot_matches_new_line_check->setToolTip(QString::fromWCharArray(L". 可以匹配换行符 \\n"));
     tb2->addWidget(dot_matches_new_line_check);
+    crlf_check = new QCheckBox();
+    crlf_check->setText(QString::fromWCharArray(L"CRLF"));
+    crlf_check->setToolTip(QString::fromWCharArray(L"多行模式下把 \\r\\n 当作行尾，Windows 格式的文本无需先去掉 \\r"));
+    tb2->addWidget(crlf_check);
+    tb2->addWidget(new QLabel(QString::fromWCharArray(L"行终止符")));
+    line_terminator_combo = new QComboBox();
+    line_terminator_combo->addItem("\\n", 10);
+    line_terminator_combo->addItem("NUL", 0);
+    line_terminator_combo->addItem("RS (\\x1E)", 0x1E);
+    line_terminator_combo->setToolTip(QString::fromWCharArray(L"多行模式下 ^ 和 $ 识别的行终止符，流式搜索也按它切分记录"));
+    tb2->addWidget(line_terminator_combo);
+    swap_greed_check = new QCheckBox();
+    swap_greed_check->setText(QString::fromWCharArray(L"交换贪婪"));
+    swap_greed_check->setToolTip(QString::fromWCharArray(L"a* 变为非贪婪，a*? 变为贪婪"));
+    tb2->addWidget(swap_greed_check);
+    tb2->addWidget(new QLabel(QString::fromWCharArray(L"嵌套上限")));
+    nest_limit_spin = new QSpinBox();
+    nest_limit_spin->setRange(1, 10000);
+    nest_limit_spin->setValue(250);
+    nest_limit_spin->setToolTip(QString::fromWCharArray(L"正则允许的最大嵌套深度"));
+    tb2->addWidget(nest_limit_spin);
+    unicode_check = new QCheckBox();
+    unicode_check->setText(QString::fromWCharArray(L"Unicode"));
+    unicode_check->setToolTip(QString::fromWCharArray(L"关闭后 \\w、\\d、\\s 等只匹配 ASCII 字符，正则更小、搜索更快。\n输入仍按 UTF-8 文本搜索，.、[^a]、\\W、\\S 等会匹配单个非 ASCII 字节的写法无法编译，需改写为 (?u:.)、(?u:[^a]) 等"));
+    unicode_check->setChecked(true);
+    tb2->addWidget(unicode_check);
+    unicode_btn = new QPushButton(QString::fromWCharArray(L"对比"));
+    unicode_btn->setToolTip(QString::fromWCharArray(L"在后台分别以 Unicode 和 ASCII 模式编译，对比规模和在当前输入上的速度"));
+    tb2->addWidget(unicode_btn);
+    profile_check = new QCheckBox();
+    profile_check->setText(QString::fromWCharArray(L"编译分析"));
+    profile_check->setToolTip(QString::fromWCharArray(L"分阶段编译正则，显示各阶段耗时和规模"));
+    tb2->addWidget(profile_check);
+    tb2->addWidget(new QLabel(QString::fromWCharArray(L"DFA 缓存")));
+    dfa_size_spin = new QSpinBox();
+    dfa_size_spin->setRange(1, 1024);
+    dfa_size_spin->setValue(2);
+    dfa_size_spin->setSuffix(" MB");
+    dfa_size_spin->setToolTip(QString::fromWCharArray(L"懒惰 DFA 的缓存大小，缓存反复清空时应调大"));
+    tb2->addWidget(dfa_size_spin);
+    tb2->addWidget(new QLabel(QString::fromWCharArray(L"线程")));
+    threads_spin = new QSpinBox();
+    threads_spin->setRange(0, 256);
+    threads_spin->setSpecialValueText(QString::fromWCharArray(L"自动"));
+    threads_spin->setToolTip(QString::fromWCharArray(L"引擎并行搜索使用的线程数，自动表示使用全部核心"));
+    tb2->addWidget(threads_spin);
+    tb2->addWidget(new QLabel(QString::fromWCharArray(L"结果上限")));
+    budget_spin = new QSpinBox();
+    budget_spin->setRange(0, 65536);
+    budget_spin->setValue(512);
+    budget_spin->setSuffix(" MB");
+    budget_spin->setSpecialValueText(QString::fromWCharArray(L"不限"));
+    budget_spin->setToolTip(QString::fromWCharArray(L"匹配结果和表格占用内存的上限，超过后改为写入磁盘，由表格按需读取"));
+    tb2->addWidget(budget_spin);
+    disk_check = new QCheckBox(QString::fromWCharArray(L"写入磁盘"));
+    disk_check->setToolTip(QString::fromWCharArray(L"把全部匹配写入临时文件，表格按需读取，不受结果上限限制\n不显示匹配分布"));
+    tb2->addWidget(disk_check);
     addToolBar(tb2);
 
     resize(800, 600);
@@ -45,6 +209,14 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     tree_model = new QStandardItemModel();
     treeview->setModel(tree_model);
 
+    profile_view = new QTableView();
+    profile_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    profile_view->verticalHeader()->setHidden(true);
+    profile_view->horizontalHeader()->setStretchLastSection(true);
+    profile_view->setHidden(true);
+    profile_model = new QStandardItemModel();
+    profile_view->setModel(profile_model);
+
     auto right_widget = new QWidget();
     auto right_layout = new QVBoxLayout();
     right_layout->setContentsMargins(0, 0, 0, 0);
@@ -60,7 +232,15 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
 
     input_edit = new QPlainTextEdit();
     input_edit->setPlaceholderText(QString::fromWCharArray(L"在此输入用来匹配的文本"));
-    right_layout->addWidget(input_edit);
+    minimap = new Minimap();
+    auto input_widget = new QWidget();
+    auto input_layout = new QHBoxLayout();
+    input_layout->setContentsMargins(0, 0, 0, 0);
+    input_layout->setSpacing(0);
+    input_widget->setLayout(input_layout);
+    input_layout->addWidget(input_edit);
+    input_layout->addWidget(minimap);
+    right_layout->addWidget(input_widget);
 
     auto groupbox = new QGroupBox(QString::fromWCharArray(L"结果"));
     auto grouplayout = new QVBoxLayout();
@@ -81,7 +261,11 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     table_menu->addAction(QString::fromWCharArray(L"导出 csv"), this, &MainWindow::onTableExportCsv);
 
     auto sp_top = new QSplitter(Qt::Orientation::Horizontal);
-    sp_top->addWidget(treeview);
+    auto sp_left = new QSplitter(Qt::Orientation::Vertical);
+    sp_left->addWidget(treeview);
+    sp_left->addWidget(profile_view);
+    sp_left->setChildrenCollapsible(false);
+    sp_top->addWidget(sp_left);
     sp_top->addWidget(right_widget);
     sp_top->setChildrenCollapsible(false);
     sp_top->setStretchFactor(0, 1);
@@ -98,11 +282,39 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     connect(treeview->selectionModel(), &QItemSelectionModel::currentRowChanged, this, &MainWindow::onTreeCurrentChanged);
     connect(regex_edit, &QPlainTextEdit::textChanged, this, &MainWindow::onTextChanged);
     connect(exec_btn, &QPushButton::clicked, this, &MainWindow::onExecBtnClicked);
+    connect(stream_btn, &QPushButton::clicked, this, &MainWindow::onStreamFile);
+    connect(sample_btn, &QPushButton::clicked, this, &MainWindow::onSampleFile);
+    connect(csv_btn, &QPushButton::clicked, this, &MainWindow::onSearchCsv);
+    connect(stop_btn, &QPushButton::clicked, this, [this]()
+            {
+        if (file_search)
+        {
+            file_search->cancel = true;
+        } });
+    connect(save_btn, &QPushButton::clicked, this, &MainWindow::onSaveResults);
+    connect(open_btn, &QPushButton::clicked, this, &MainWindow::onOpenResults);
     connect(ignore_whitespace_check, &QCheckBox::stateChanged, this, &MainWindow::onCheckChanged);
     connect(case_insensitive_check, &QCheckBox::stateChanged, this, &MainWindow::onCheckChanged);
     connect(multi_line_check, &QCheckBox::stateChanged, this, &MainWindow::onCheckChanged);
     connect(dot_matches_new_line_check, &QCheckBox::stateChanged, this, &MainWindow::onCheckChanged);
+    connect(unicode_check, &QCheckBox::stateChanged, this, &MainWindow::onCheckChanged);
+    connect(crlf_check, &QCheckBox::stateChanged, this, &MainWindow::onCheckChanged);
+    connect(line_terminator_combo, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &MainWindow::onCheckChanged);
+    connect(swap_greed_check, &QCheckBox::stateChanged, this, &MainWindow::onCheckChanged);
+    connect(nest_limit_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &MainWindow::onCheckChanged);
+    connect(unicode_btn, &QPushButton::clicked, this, &MainWindow::onUnicodeAdvice);
+    connect(library_btn, &QPushButton::clicked, this, &MainWindow::onLoadLibrary);
+    connect(library_combo, static_cast<void (QComboBox::*)(int)>(&QComboBox::activated), this, &MainWindow::onLibraryPicked);
+    connect(profile_check, &QCheckBox::stateChanged, this, &MainWindow::onCheckChanged);
+    connect(dfa_size_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &MainWindow::onCheckChanged);
+    connect(threads_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, [](int value)
+            { pool_set_threads(value); });
     connect(timer, &QTimer::timeout, this, &MainWindow::onTimer);
+    connect(input_edit, &QPlainTextEdit::textChanged, minimap, &Minimap::clear);
+    connect(input_edit, &QPlainTextEdit::textChanged, this, [this]()
+            { haystack = std::nullopt; });
+    connect(minimap, &Minimap::clicked, this, &MainWindow::onMinimapClicked);
+    connect(result_edit, &QPlainTextEdit::cursorPositionChanged, this, &MainWindow::onResultCursorChanged);
     connect(combo, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &MainWindow::onComboChanged);
     connect(result_table->selectionModel(), &QItemSelectionModel::currentChanged, this, &MainWindow::onTableSelectionChanged);
 
@@ -112,6 +324,13 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
 
     // 强制刷新
     onTimer();
+
+    // 程序目录下有默认的模式库时，启动时就在后台编译
+    auto default_library = QCoreApplication::applicationDirPath() + "/patterns.txt";
+    if (QFile::exists(default_library))
+    {
+        loadLibrary(default_library);
+    }
 }
 
 void MainWindow::onComboChanged(int index)
@@ -141,6 +360,9 @@ void MainWindow::setTextColor(QPlainTextEdit *edit, int start, int end)
 {
     // 转换偏移，从 UTF-8 偏移转到 UTF-16 偏移
     auto utf8_str = edit->toPlainText().toUtf8();
+    // 替换结果、结果文件和磁盘结果集中的偏移可能来自修改前的文本
+    start = std::clamp<int>(start, 0, utf8_str.size());
+    end = std::clamp<int>(end, start, utf8_str.size());
     start = QString::fromUtf8(utf8_str.data(), start).size();
     end = QString::fromUtf8(utf8_str.data(), end).size();
 
@@ -173,17 +395,160 @@ void MainWindow::setTextColor(QPlainTextEdit *edit, int start, int end)
     edit->setExtraSelections(extraSelections);
 }
 
-void MainWindow::fillTree(QStandardItem *parent, const TreeNode *tree)
+void MainWindow::fillTree(const ParseTree &tree)
+{
+    auto str = [&tree](uint32_t start, uint32_t len)
+    {
+        return QString::fromUtf8(tree.strings.data() + start, len);
+    };
+    // 节点按先序排列，父节点总在子节点之前
+    std::vector<QStandardItem *> items(tree.nodes.size());
+    for (size_t i = 0; i < tree.nodes.size(); i++)
+    {
+        auto &node = tree.nodes[i];
+        auto content = str(node.content_start, node.content_len);
+        auto item = new QStandardItem(str(node.title_start, node.title_len));
+        item->setData(QPoint(node.start, node.end), Qt::UserRole + 1);
+        item->setData(content, Qt::UserRole + 2);
+        item->setToolTip(content);
+        items[i] = item;
+        if (node.parent != UINT32_MAX)
+        {
+            items[node.parent]->appendRow(item);
+        }
+    }
+    // 整棵树建好后再放进模型，避免逐个节点通知视图
+    if (!items.empty())
+    {
+        tree_model->appendRow(items[0]);
+    }
+}
+
+void MainWindow::fillProfile()
+{
+    profile_model->clear();
+    profile_view->setHidden(!profile_check->isChecked());
+    if (!profile_check->isChecked() || !re.has_value())
+    {
+        return;
+    }
+    profile_model->setHorizontalHeaderLabels({QString::fromWCharArray(L"阶段"), QString::fromWCharArray(L"耗时 / 规模")});
+    auto addRow = [this](const QString &name, const QString &value)
+    {
+        profile_model->appendRow({new QStandardItem(name), new QStandardItem(value)});
+    };
+    auto profile = regex_profile(re.value());
+    for (auto &&i : profile.phases)
+    {
+        addRow(QString::fromUtf8(i.name.data(), i.name.size()), QString("%1 ms").arg(i.micros / 1000.0, 0, 'f', 3));
+    }
+    addRow(QString::fromWCharArray(L"AST 节点"), QString::number(profile.ast_nodes));
+    addRow(QString::fromWCharArray(L"HIR 节点"), QString::number(profile.hir_nodes));
+    addRow(QString::fromWCharArray(L"字符类范围"), QString::number(profile.class_ranges));
+    addRow(QString::fromWCharArray(L"匹配器内存"), QString("%1 KB").arg(profile.matcher_memory / 1024.0, 0, 'f', 1));
+    try
+    {
+        auto cost = regex_estimate_cost(re.value());
+        QStringList warnings;
+        for (auto &&i : cost.warnings)
+        {
+            warnings.append(QString::fromUtf8(i.data(), i.size()));
+        }
+        addRow(QString::fromWCharArray(L"代价评级"), costRating(cost.rating));
+        profile_model->item(profile_model->rowCount() - 1, 1)->setToolTip(warnings.join("\n"));
+        // NFA 和前缀过滤器的信息来自代价估算，编译时不为统计另外构建
+        addRow(QString::fromWCharArray(L"NFA 状态"), QString::number(cost.nfa_states));
+        addRow(QString::fromWCharArray(L"前缀过滤器"), QString::fromWCharArray(cost.prefilter ? L"可用" : L"无"));
+        addRow(QString::fromWCharArray(L"完整 DFA"), QString::fromWCharArray(cost.full_dfa ? L"可以构建" : L"无法构建"));
+        addRow(QString::fromWCharArray(L"单遍 DFA"), QString::fromWCharArray(cost.onepass ? L"可用" : L"不可用"));
+    }
+    catch (const std::exception &)
+    {
+    }
+}
+
+RegexOptions MainWindow::regexOptions()
+{
+    RegexOptions options;
+    options.ignore_whitespace = ignore_whitespace_check->isChecked();
+    options.case_insensitive = case_insensitive_check->isChecked();
+    options.multi_line = multi_line_check->isChecked();
+    options.dot_matches_new_line = dot_matches_new_line_check->isChecked();
+    options.unicode = unicode_check->isChecked();
+    options.crlf = crlf_check->isChecked();
+    options.line_terminator = static_cast<uint8_t>(line_terminator_combo->currentData().toInt());
+    options.swap_greed = swap_greed_check->isChecked();
+    options.nest_limit = nest_limit_spin->value();
+    options.profile = profile_check->isChecked();
+    options.dfa_size_limit = static_cast<size_t>(dfa_size_spin->value()) << 20;
+    return options;
+}
+
+const rust::Box<ReplaceTemplate> &MainWindow::replaceTemplate()
+{
+    if (!re.has_value())
+    {
+        throw std::runtime_error(QString::fromWCharArray(L"无法解析").toUtf8().data());
+    }
+    // 模板绑定到当前的正则，正则或替换文本变化时才重新编译
+    auto rep = replace_edit->toPlainText();
+    if (!rep_template.has_value() || rep != last_rep)
+    {
+        rep_template = std::nullopt;
+        rep_template = template_new(re.value(), toStr(rep.toUtf8()));
+        last_rep = rep;
+    }
+    return rep_template.value();
+}
+
+const rust::Box<Haystack> &MainWindow::inputHaystack()
+{
+    // 只在输入变化后转换、检查一次编码
+    if (!haystack.has_value())
+    {
+        QString text;
+        {
+            TraceScope trace("read input text");
+            text = input_edit->toPlainText();
+        }
+        QByteArray utf8;
+        {
+            TraceScope trace("convert to UTF-8");
+            utf8 = text.toUtf8();
+        }
+        haystack = haystack_new(toBytes(utf8));
+    }
+    return haystack.value();
+}
+
+bool MainWindow::confirmCost(qint64 input_size)
 {
-    parent->setText(QString::fromUtf8(tree->title.data(), tree->title.size()));
-    parent->setData(QPoint(tree->start, tree->end), Qt::UserRole + 1);
-    parent->setData(QString::fromUtf8(tree->content.data(), tree->content.size()), Qt::UserRole + 2);
-    parent->setToolTip(QString::fromUtf8(tree->content.data(), tree->content.size()));
-    for (auto &i : tree->children)
+    // 输入不大时怎样都很快，不必打扰
+    const qint64 large_input = 16 << 20;
+    if (input_size < large_input || !re.has_value())
+    {
+        return true;
+    }
+    try
+    {
+        auto cost = regex_estimate_cost(re.value());
+        if (cost.rating < 2)
+        {
+            return true;
+        }
+        QStringList lines;
+        lines.append(QString::fromWCharArray(L"输入大小 %1 MB，该正则的搜索代价评级为“%2”：").arg(input_size >> 20).arg(costRating(cost.rating)));
+        for (auto &&i : cost.warnings)
+        {
+            lines.append(QString::fromUtf8(i.data(), i.size()));
+        }
+        lines.append(QString::fromWCharArray(L"是否继续？"));
+        return QMessageBox::question(this, QString::fromWCharArray(L"搜索可能很慢"), lines.join("\n")) == QMessageBox::Yes;
+    }
+    catch (const std::exception &)
     {
-        auto child = new QStandardItem();
-        parent->appendRow(child);
-        fillTree(child, &i);
+        // 估算失败不影响搜索本身
+        return true;
     }
 }
 
@@ -200,20 +565,24 @@ void MainWindow::onTimer()
         tree_model->clear();
         last_regex.clear();
         re = std::nullopt;
+        rep_template = std::nullopt;
         try
         {
             last_regex = text;
-            auto tree = regex_parse(text.toUtf8().data(), ignore_whitespace_check->isChecked());
-            re = regex_new(text.toUtf8().data(), ignore_whitespace_check->isChecked(), case_insensitive_check->isChecked(), multi_line_check->isChecked(), dot_matches_new_line_check->isChecked());
-            auto root = new QStandardItem();
-            fillTree(root, &tree);
-            tree_model->appendRow(root);
+            ParseTree tree;
+            {
+                TraceScope trace("compile regex");
+                re = regex_analyze_and_build(toStr(text.toUtf8()), regexOptions(), tree);
+            }
+            TraceScope trace("fill parse tree");
+            fillTree(tree);
         }
         catch (const std::exception &ex)
         {
             tree_model->appendRow(new QStandardItem(QString::fromWCharArray(L"错误：%1").arg(QString::fromUtf8(ex.what()))));
         }
         treeview->expandAll();
+        fillProfile();
     }
 }
 
@@ -227,34 +596,60 @@ void MainWindow::onTreeCurrentChanged(const QModelIndex &current, const QModelIn
 
 void MainWindow::onMatch()
 {
-    auto s = input_edit->toPlainText().toUtf8();
+    if (disk_check->isChecked())
+    {
+        onMatchToDisk();
+        return;
+    }
     try
     {
         if (!re.has_value())
         {
             throw std::runtime_error(QString::fromWCharArray(L"无法解析").toUtf8().data());
         }
-        auto result = regex_match(re.value(), s.data());
-        table_model->setColumnCount(result.group_names.size());
-        for (size_t i = 0; i < result.group_names.size(); i++)
+        auto budget = static_cast<size_t>(budget_spin->value()) << 20;
+        // 表格的内存才是大头：每个单元格的固定开销，加上 UTF-8 和 UTF-16 两份文本，一并计入上限
+        auto collected = regex_match_collect(re.value(), inputHaystack(), minimap->bucketCount(), budget, table_cell_bytes);
+        if (match_result_spilled(collected))
+        {
+            // 超过上限时已在同一次搜索中写入磁盘，表格按需读取，内存占用与匹配数量无关
+            showMatchStore(match_result_store(std::move(collected)));
+            statusbar->showMessage(QString::fromWCharArray(L"结果超过内存上限，已改为写入磁盘。%1").arg(statusbar->currentMessage()));
+            return;
+        }
+        auto &result = match_result_columns(collected);
+        minimap->setDensity(std::vector<uint32_t>(result.density.begin(), result.density.end()));
+        TraceScope trace("fill table model");
+        auto group_names = regex_group_names(re.value());
+        table_model->setColumnCount(group_names.size());
+        for (size_t i = 0; i < group_names.size(); i++)
         {
-            if (result.group_names[i].length())
+            if (group_names[i].length())
             {
-                table_model->setHeaderData(i, Qt::Orientation::Horizontal, QString("%1(%2)").arg(QString::fromUtf8(result.group_names[i].data(), result.group_names[i].size()), QString::number(i)));
+                table_model->setHeaderData(i, Qt::Orientation::Horizontal, QString("%1(%2)").arg(QString::fromUtf8(group_names[i].data(), group_names[i].size()), QString::number(i)));
             }
             else
             {
                 table_model->setHeaderData(i, Qt::Orientation::Horizontal, QString::number(i));
             }
         }
-        for (auto &&m : result.matches)
+        for (size_t m = 0; m < result.len; m++)
         {
             auto row = QList<QStandardItem *>();
-            for (auto &&g : m.groups)
+            for (auto &&g : result.columns)
             {
-                auto text = QString::fromUtf8(g.text.data(), g.text.size());
+                auto value_start = g.value_offsets[m];
+                auto text = QString::fromUtf8(g.values.data() + value_start, g.value_offsets[m + 1] - value_start);
                 auto item = new QStandardItem(text);
-                item->setData(QPoint(g.start, g.end), Qt::UserRole + 1);
+                // 未参与匹配的分组
+                if (g.spans[m * 2] == UINT32_MAX)
+                {
+                    item->setData(QPoint(0, 0), Qt::UserRole + 1);
+                }
+                else
+                {
+                    item->setData(QPoint(g.spans[m * 2], g.spans[m * 2 + 1]), Qt::UserRole + 1);
+                }
                 item->setToolTip(text);
                 row.append(item);
             }
@@ -265,22 +660,72 @@ void MainWindow::onMatch()
     {
         table_model->appendRow(new QStandardItem(QString::fromWCharArray(L"错误：%1").arg(QString::fromUtf8(ex.what()))));
     }
+    if (trace_enabled())
+    {
+        // 表格平时在之后的事件循环中绘制，记录 trace 时立即绘制以便计时
+        TraceScope trace("render table");
+        result_table->viewport()->repaint();
+    }
     // result_table->resizeRowsToContents();
     // result_table->resizeColumnsToContents();
 }
 
-void MainWindow::onReplace()
+void MainWindow::onMatchToDisk()
 {
-    auto text = input_edit->toPlainText().toUtf8();
-    auto rep = replace_edit->toPlainText().toUtf8();
     try
     {
         if (!re.has_value())
         {
             throw std::runtime_error(QString::fromWCharArray(L"无法解析").toUtf8().data());
         }
-        auto result = regex_replace(re.value(), text.data(), rep.data());
-        result_edit->setPlainText(QString::fromUtf8(result.data(), result.size()));
+        showMatchStore(store_matches(re.value(), inputHaystack(), minimap->bucketCount()));
+    }
+    catch (const std::exception &ex)
+    {
+        table_model->appendRow(new QStandardItem(QString::fromWCharArray(L"错误：%1").arg(QString::fromUtf8(ex.what()))));
+    }
+}
+
+void MainWindow::showMatchStore(rust::Box<MatchStore> store)
+{
+    auto &density = store_layout(store).density;
+    minimap->setDensity(std::vector<uint32_t>(density.begin(), density.end()));
+    auto model = new MatchStoreModel(std::move(store), this);
+    QString error;
+    if (!model->open(error))
+    {
+        delete model;
+        throw std::runtime_error(error.toUtf8().data());
+    }
+    setTableModel(model);
+    store_model = model;
+    statusbar->showMessage(QString::fromWCharArray(L"共 %1 个匹配").arg(model->matchCount()));
+}
+
+void MainWindow::onReplace()
+{
+    try
+    {
+        auto &rep = replaceTemplate();
+        auto result = regex_replace(re.value(), inputHaystack(), rep);
+        {
+            TraceScope trace("show replaced text");
+            result_edit->setPlainText(QString::fromUtf8(result.text.data(), result.text.size()));
+        }
+        std::vector<uint32_t> offsets;
+        offsets.reserve(result.spans.size() * 2);
+        for (auto &&i : result.spans)
+        {
+            offsets.push_back(i.out_start);
+            offsets.push_back(i.out_end);
+        }
+        auto pos = utf8ToUtf16(result.text.data(), result.text.size(), offsets);
+        for (size_t i = 0; i < pos.size(); i += 2)
+        {
+            replace_out.emplace_back(pos[i], pos[i + 1]);
+        }
+        replace_spans = std::move(result.spans);
+        highlightReplaced();
     }
     catch (const std::exception &ex)
     {
@@ -288,16 +733,59 @@ void MainWindow::onReplace()
     }
 }
 
+void MainWindow::highlightReplaced()
+{
+    // 替换段过多时只高亮前面一部分，避免拖慢编辑框
+    const size_t max_highlights = 10000;
+    auto fmt = QTextCharFormat();
+    fmt.setBackground(QBrush(QColor(Qt::green).lighter(170)));
+    QList<QTextEdit::ExtraSelection> extraSelections;
+    auto cursor = result_edit->textCursor();
+    for (size_t i = 0; i < replace_out.size() && i < max_highlights; i++)
+    {
+        if (replace_out[i].first == replace_out[i].second)
+        {
+            continue;
+        }
+        cursor.setPosition(replace_out[i].first);
+        cursor.setPosition(replace_out[i].second, QTextCursor::KeepAnchor);
+        QTextEdit::ExtraSelection selection;
+        selection.cursor = cursor;
+        selection.format = fmt;
+        extraSelections.append(selection);
+    }
+    result_edit->setExtraSelections(extraSelections);
+}
+
+void MainWindow::onResultCursorChanged()
+{
+    if (replace_out.empty())
+    {
+        return;
+    }
+    // 二分查找光标所在的替换段
+    auto pos = result_edit->textCursor().position();
+    auto it = std::upper_bound(replace_out.begin(), replace_out.end(), pos, [](int pos, const std::pair<int, int> &span)
+                               { return pos < span.first; });
+    if (it == replace_out.begin() || pos > (--it)->second)
+    {
+        return;
+    }
+    auto index = it - replace_out.begin();
+    auto &span = replace_spans[index];
+    setTextColor(input_edit, span.in_start, span.in_end);
+    statusbar->showMessage(QString::fromWCharArray(L"第 %1 个匹配 (%2, %3)").arg(index + 1).arg(span.in_start).arg(span.in_end));
+}
+
 void MainWindow::onSplit()
 {
-    auto text = input_edit->toPlainText().toUtf8();
     try
     {
         if (!re.has_value())
         {
             throw std::runtime_error(QString::fromWCharArray(L"无法解析").toUtf8().data());
         }
-        auto result = regex_split(re.value(), text.data());
+        auto result = regex_split(re.value(), inputHaystack());
         QStringList list;
         for (auto &&i : result)
         {
@@ -311,139 +799,1048 @@ void MainWindow::onSplit()
     }
 }
 
-void MainWindow::onExecBtnClicked()
+void MainWindow::onDfaStats()
 {
-    // 强制刷新
-    onTimer();
-
-    table_model->clear();
-    result_edit->clear();
-
-    switch (combo->currentIndex())
+    try
+    {
+        if (!re.has_value())
+        {
+            throw std::runtime_error(QString::fromWCharArray(L"无法解析").toUtf8().data());
+        }
+        auto stats = regex_dfa_stats(re.value(), inputHaystack());
+        QStringList lines;
+        if (!stats.not_applicable.empty())
+        {
+            auto message = QString::fromUtf8(stats.not_applicable.data(), stats.not_applicable.size());
+            lines.append(message);
+            statusbar->showMessage(message);
+        }
+        lines.append(QString::fromWCharArray(L"输入字节：%1").arg(stats.input_bytes));
+        lines.append(QString::fromWCharArray(L"匹配数量：%1").arg(stats.matches));
+        lines.append(QString::fromWCharArray(L"耗时：%1 ms").arg(stats.micros / 1000.0, 0, 'f', 3));
+        lines.append(QString::fromWCharArray(L"缓存大小：%1 KB").arg(stats.cache_capacity / 1024));
+        lines.append(QString::fromWCharArray(L"缓存内存：%1 KB").arg(stats.cache_memory / 1024));
+        lines.append(QString::fromWCharArray(L"缓存清空次数：%1").arg(stats.cache_clears));
+        if (stats.thrashing)
+        {
+            auto message = QString::fromWCharArray(L"警告：缓存反复清空，懒惰 DFA 已退化到接近 PikeVM 的速度，建议把 DFA 缓存调大到 %1 MB").arg((stats.suggested_capacity + (1 << 20) - 1) >> 20);
+            lines.append(message);
+            statusbar->showMessage(message);
+        }
+        result_edit->setPlainText(lines.join("\n"));
+    }
+    catch (const std::exception &ex)
     {
-    case 0:
-        onMatch();
-        break;
-    case 1:
-        onReplace();
-        break;
-    case 2:
-        onSplit();
-        break;
-    default:
-        break;
+        result_edit->setPlainText(QString::fromWCharArray(L"错误：%1").arg(QString::fromUtf8(ex.what())));
     }
 }
 
-void MainWindow::onCheckChanged()
+void MainWindow::onUnicodeAdvice()
 {
-    last_regex.clear();
-    onTextChanged();
+    unicode_btn->setEnabled(false);
+    statusbar->showMessage(QString::fromWCharArray(L"正在对比 Unicode 和 ASCII 模式……"));
+    // 后台线程只使用复制出来的数据，完成后回到界面线程显示
+    auto pattern = regex_edit->toPlainText().toUtf8();
+    auto text = input_edit->toPlainText().toUtf8();
+    auto options = regexOptions();
+    auto advice = std::make_shared<std::optional<UnicodeAdvice>>();
+    auto error = std::make_shared<QString>();
+    auto work = [pattern, text, options, advice, error]()
+    {
+        try
+        {
+            *advice = regex_unicode_advice(toStr(pattern), options, toBytes(text));
+        }
+        catch (const std::exception &ex)
+        {
+            *error = QString::fromUtf8(ex.what());
+        }
+    };
+    auto done = [this, advice, error]()
+    {
+        unicode_btn->setEnabled(true);
+        statusbar->clearMessage();
+        if (advice->has_value())
+        {
+            showUnicodeAdvice(advice->value());
+        }
+        else
+        {
+            QMessageBox::critical(this, QString::fromWCharArray(L"错误"), *error);
+        }
+    };
+    runInBackground(work, done);
 }
 
-QList<QStringList> MainWindow::getTableSelectedItems()
+void MainWindow::showUnicodeAdvice(const UnicodeAdvice &advice)
 {
-    QList<QStringList> result;
-    QStringList rowlist;
-    int lastrow = 0;
-    for (auto &&i : result_table->selectionModel()->selectedIndexes())
+    auto speed = [&advice](uint64_t micros)
     {
-        if (rowlist.empty())
-        {
-            lastrow = i.row();
-        }
-        if (i.row() != lastrow)
+        if (micros == 0)
         {
-            lastrow = i.row();
-            result.append(rowlist);
-            rowlist.clear();
+            return QString("-");
         }
-        rowlist.append(i.data().toString());
+        return QString("%1 MB/s").arg(advice.sampled_bytes / (double)micros, 0, 'f', 1);
+    };
+    QStringList lines;
+    lines.append(QString::fromWCharArray(L"Unicode：NFA %1 个状态，%2 KB，%3，%4 个匹配")
+                     .arg(advice.unicode_nfa_states)
+                     .arg(advice.unicode_nfa_memory / 1024)
+                     .arg(speed(advice.unicode_micros))
+                     .arg(advice.unicode_matches));
+    QMessageBox box(this);
+    box.setWindowTitle(QString::fromWCharArray(L"Unicode 与 ASCII 对比"));
+    if (!advice.ascii_error.empty())
+    {
+        lines.append(QString::fromWCharArray(L"ASCII：无法编译，%1").arg(QString::fromUtf8(advice.ascii_error.data(), advice.ascii_error.size())));
+        box.setText(lines.join("\n"));
+        box.exec();
+        return;
     }
-    if (!rowlist.empty())
+    lines.append(QString::fromWCharArray(L"ASCII：NFA %1 个状态，%2 KB，%3，%4 个匹配")
+                     .arg(advice.ascii_nfa_states)
+                     .arg(advice.ascii_nfa_memory / 1024)
+                     .arg(speed(advice.ascii_micros))
+                     .arg(advice.ascii_matches));
+    if (advice.ascii_matches != advice.unicode_matches)
     {
-        result.append(rowlist);
+        lines.append(QString::fromWCharArray(L"注意：两种模式在当前输入上的匹配结果不同"));
+    }
+    lines.append(QString::fromWCharArray(L"（测速只使用输入开头的 %1 KB）").arg(advice.sampled_bytes / 1024));
+    box.setText(lines.join("\n"));
+    QPushButton *ascii_btn = nullptr;
+    if (unicode_check->isChecked())
+    {
+        ascii_btn = box.addButton(QString::fromWCharArray(L"切换到 ASCII 模式"), QMessageBox::AcceptRole);
+    }
+    box.addButton(QMessageBox::Close);
+    box.exec();
+    if (ascii_btn != nullptr && box.clickedButton() == ascii_btn)
+    {
+        unicode_check->setChecked(false);
     }
-    return result;
 }
 
-void MainWindow::onTableCopy()
+void MainWindow::onLoadLibrary()
 {
-    auto items = getTableSelectedItems();
-    QStringList result;
-    for (auto &&i : items)
+    auto filename = QFileDialog::getOpenFileName(this, QString::fromWCharArray(L"选择模式库"), "", "*.txt;;*");
+    if (!filename.isEmpty())
     {
-        result.append(i.join("\t"));
+        loadLibrary(filename);
     }
-    qApp->clipboard()->setText(result.join("\n"));
 }
 
-void MainWindow::onTableExportCsv()
+void MainWindow::loadLibrary(const QString &filename)
 {
-    auto filename = QFileDialog::getSaveFileName(this, QString::fromWCharArray(L"选择导出文件"), "", "*.csv");
-    if (!filename.isEmpty())
+    library_btn->setEnabled(false);
+    library_combo->setEnabled(false);
+    statusbar->showMessage(QString::fromWCharArray(L"正在编译模式库……"));
+    // 与 onUnicodeAdvice 相同，后台线程只使用复制出来的数据
+    auto path = filename.toUtf8();
+    auto options = regexOptions();
+    // rust::Box 不能复制，放在共享指针中传回界面线程
+    auto result = std::make_shared<std::optional<rust::Box<PatternLibrary>>>();
+    auto error = std::make_shared<QString>();
+    auto load_ms = std::make_shared<double>();
+    auto work = [path, options, result, error, load_ms]()
     {
-        QFile f(filename);
-        if (!f.open(QIODevice::WriteOnly | QIODevice::Text))
+        auto start = std::chrono::steady_clock::now();
+        try
         {
-            QMessageBox::critical(this, QString::fromWCharArray(L"错误"), QString::fromWCharArray(L"打开文件失败"));
-            return;
+            *result = library_load(toStr(path), options);
         }
-        std::stringstream ss;
-        auto writer = csv::make_csv_writer(ss);
-        // 输出列标题
+        catch (const std::exception &ex)
         {
-            auto n = table_model->columnCount();
-            std::vector<std::string> row;
-            for (size_t i = 0; i < n; i++)
-            {
-                auto s = table_model->headerData(i, Qt::Orientation::Horizontal).toString().toUtf8();
-                row.emplace_back(s.data(), s.size());
-            }
-            writer << row;
+            *error = QString::fromUtf8(ex.what());
         }
-        // 输出全部内容
+        *load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    auto done = [this, result, error, load_ms]()
+    {
+        library_btn->setEnabled(true);
+        statusbar->clearMessage();
+        if (result->has_value())
         {
-            auto nRow = table_model->rowCount();
-            auto nCol = table_model->columnCount();
-            for (size_t r = 0; r < nRow; r++)
-            {
-                std::vector<std::string> row;
-                for (size_t c = 0; c < nCol; c++)
-                {
-                    auto index = table_model->index(r, c);
-                    auto s = table_model->data(index).toString().toUtf8();
-                    row.emplace_back(s.data(), s.size());
-                }
-                writer << row;
-            }
+            library = std::move(*result);
+            showLibrary(*load_ms);
         }
-        // UTF-8 BOM
-        f.write("\xEF\xBB\xBF");
-        f.write(ss.str().c_str());
-    }
+        else
+        {
+            library_combo->setEnabled(library.has_value());
+            QMessageBox::critical(this, QString::fromWCharArray(L"错误"), *error);
+        }
+    };
+    runInBackground(work, done);
 }
 
-void MainWindow::onTableSelectionChanged(const QModelIndex &current, const QModelIndex &previous)
+void MainWindow::runInBackground(std::function<void()> work, std::function<void()> done)
 {
-    auto point = current.data(Qt::UserRole + 1).toPoint();
-    setTextColor(input_edit, point.x(), point.y());
-    statusbar->showMessage(QString("(%1, %2) %3").arg(point.x()).arg(point.y()).arg(current.data().toString()));
+    // watcher 属于窗口，窗口关闭后不会再回调；析构函数等待 background 中的任务全部结束
+    auto watcher = new QFutureWatcher<void>(this);
+    connect(watcher, &QFutureWatcher<void>::finished, this, [watcher, done]()
+            {
+        watcher->deleteLater();
+        done(); });
+    watcher->setFuture(QtConcurrent::run(&background, work));
 }
 
-bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+void MainWindow::showLibrary(double load_ms)
 {
-    if (watched == regex_edit || watched == input_edit)
+    auto entries = library_entries(library.value());
+    library_combo->clear();
+    // 结果表中列出每条的编译耗时和内存
+    stopFileSearch();
+    setTableModel(table_model);
+    table_model->clear();
+    table_model->setHorizontalHeaderLabels({QString::fromWCharArray(L"名称"), QString::fromWCharArray(L"耗时 ms"), QString::fromWCharArray(L"内存 KB"), QString::fromWCharArray(L"正则 / 错误")});
+    size_t failed = 0;
+    uint64_t memory = 0;
+    for (size_t i = 0; i < entries.size(); i++)
     {
-        if (event->type() == QEvent::FocusIn)
+        auto &entry = entries[i];
+        auto name = QString::fromUtf8(entry.name.data(), entry.name.size());
+        auto pattern = QString::fromUtf8(entry.pattern.data(), entry.pattern.size());
+        auto error = QString::fromUtf8(entry.error.data(), entry.error.size());
+        library_combo->addItem(name);
+        library_combo->setItemData(i, error.isEmpty() ? pattern : QString::fromWCharArray(L"%1\n错误：%2").arg(pattern, error), Qt::ToolTipRole);
+        if (!error.isEmpty())
         {
-            resetTextColor(static_cast<QPlainTextEdit *>(watched));
+            failed++;
         }
+        memory += entry.memory;
+        table_model->appendRow({new QStandardItem(name),
+                                new QStandardItem(QString::number(entry.micros / 1000.0, 'f', 3)),
+                                new QStandardItem(QString::number(entry.memory / 1024.0, 'f', 1)),
+                                new QStandardItem(error.isEmpty() ? pattern : error)});
     }
-    else if (watched == result_table)
+    library_combo->setCurrentIndex(-1);
+    library_combo->setEnabled(entries.size() != 0);
+    statusbar->showMessage(QString::fromWCharArray(L"模式库共 %1 条，失败 %2 条，耗时 %3 ms，共占用内存 %4 KB")
+                               .arg(entries.size())
+                               .arg(failed)
+                               .arg(load_ms, 0, 'f', 1)
+                               .arg(memory / 1024.0, 0, 'f', 1));
+}
+
+void MainWindow::onLibraryPicked(int index)
+{
+    if (!library.has_value() || index < 0)
     {
-        if (event->type() == QEvent::ContextMenu)
-        {
+        return;
+    }
+    auto &entry = library_entries(library.value())[index];
+    auto pattern = QString::fromUtf8(entry.pattern.data(), entry.pattern.size());
+    tree_model->clear();
+    re = std::nullopt;
+    rep_template = std::nullopt;
+    try
+    {
+        // 选项与加载时相同时直接使用已编译的正则，语法树与正则一起返回，不再解析一遍
+        ParseTree tree;
+        re = library_regex(library.value(), index, regexOptions(), tree);
+        fillTree(tree);
+    }
+    catch (const std::exception &ex)
+    {
+        tree_model->appendRow(new QStandardItem(QString::fromWCharArray(L"错误：%1").arg(QString::fromUtf8(ex.what()))));
+    }
+    // 先记下文本，setPlainText 触发的定时器不会再编译一遍
+    last_regex = pattern;
+    regex_edit->setPlainText(pattern);
+    treeview->expandAll();
+    fillProfile();
+}
+
+void MainWindow::onStreamFile()
+{
+    // 强制刷新
+    onTimer();
+
+    auto filename = QFileDialog::getOpenFileName(this, QString::fromWCharArray(L"选择要搜索的文件"));
+    if (filename.isEmpty())
+    {
+        return;
+    }
+    // 后台搜索期间一直保持打开
+    auto f = std::make_shared<QFile>(filename);
+    if (!f->open(QIODevice::ReadOnly))
+    {
+        QMessageBox::critical(this, QString::fromWCharArray(L"错误"), QString::fromWCharArray(L"打开文件失败"));
+        return;
+    }
+    if (!confirmCost(f->size()))
+    {
+        return;
+    }
+
+    // 替换模式下把替换结果逐块写入另一个文件
+    if (combo->currentIndex() == 1)
+    {
+        auto outname = QFileDialog::getSaveFileName(this, QString::fromWCharArray(L"选择输出文件"));
+        if (outname.isEmpty())
+        {
+            return;
+        }
+        auto out = std::make_shared<QFile>(outname);
+        if (!out->open(QIODevice::WriteOnly))
+        {
+            QMessageBox::critical(this, QString::fromWCharArray(L"错误"), QString::fromWCharArray(L"打开文件失败"));
+            return;
+        }
+        std::shared_ptr<rust::Box<ReplaceStream>> stream;
+        try
+        {
+            auto &rep = replaceTemplate();
+            stream = std::make_shared<rust::Box<ReplaceStream>>(regex_replace_stream_fd(re.value(), rep, f->handle(), out->handle(), 1 << 20));
+        }
+        catch (const std::exception &ex)
+        {
+            QMessageBox::critical(this, QString::fromWCharArray(L"错误"), QString::fromUtf8(ex.what()));
+            return;
+        }
+
+        // 与流式搜索相同，在后台线程中逐块替换，可以随时停止
+        auto search = beginFileSearch();
+        auto work = [this, f, out, stream, search]()
+        {
+            try
+            {
+                while (!search->cancel)
+                {
+                    auto batch = regex_replace_stream_next(*stream);
+                    if (batch.eof)
+                    {
+                        break;
+                    }
+                    search->matches += batch.count;
+                    auto message = QString::fromWCharArray(L"已替换 %1 处，已处理 %2 MB").arg(search->matches.load()).arg(batch.read >> 20);
+                    postFileRows(search, std::make_shared<std::vector<FileRow>>(), message);
+                }
+            }
+            catch (const std::exception &ex)
+            {
+                search->error = QString::fromUtf8(ex.what());
+            }
+        };
+        auto done = [this, search]()
+        {
+            // 替换结果不在表格中显示，出错时用对话框提示
+            auto error = std::exchange(search->error, QString());
+            endFileSearch(search, QString::fromWCharArray(L"已替换 %1 处").arg(search->matches.load()));
+            if (!error.isEmpty())
+            {
+                QMessageBox::critical(this, QString::fromWCharArray(L"错误"), error);
+            }
+        };
+        runInBackground(work, done);
+        return;
+    }
+
+    combo->setCurrentIndex(0);
+    setTableModel(table_model);
+    table_model->clear();
+    result_edit->clear();
+    std::shared_ptr<rust::Box<RegexStream>> stream;
+    try
+    {
+        if (!re.has_value())
+        {
+            throw std::runtime_error(QString::fromWCharArray(L"无法解析").toUtf8().data());
+        }
+        // 流中保存了正则的副本，之后修改正则不影响正在进行的搜索
+        stream = std::make_shared<rust::Box<RegexStream>>(regex_stream_fd(re.value(), f->handle(), 1 << 20));
+    }
+    catch (const std::exception &ex)
+    {
+        table_model->appendRow(new QStandardItem(QString::fromWCharArray(L"错误：%1").arg(QString::fromUtf8(ex.what()))));
+        return;
+    }
+    auto group_names = regex_group_names(re.value());
+    table_model->setColumnCount(group_names.size() + 1);
+    table_model->setHeaderData(0, Qt::Orientation::Horizontal, QString::fromWCharArray(L"偏移"));
+    for (size_t i = 0; i < group_names.size(); i++)
+    {
+        if (group_names[i].length())
+        {
+            table_model->setHeaderData(i + 1, Qt::Orientation::Horizontal, QString("%1(%2)").arg(QString::fromUtf8(group_names[i].data(), group_names[i].size()), QString::number(i)));
+        }
+        else
+        {
+            table_model->setHeaderData(i + 1, Qt::Orientation::Horizontal, QString::number(i));
+        }
+    }
+
+    // 在后台线程中逐块搜索，整理好的行分批交给界面线程，超过上限后只计数
+    auto search = beginFileSearch();
+    auto work = [this, f, stream, search]()
+    {
+        try
+        {
+            while (!search->cancel)
+            {
+                auto batch = regex_stream_next(*stream);
+                if (batch.eof)
+                {
+                    break;
+                }
+                auto rows = std::make_shared<std::vector<FileRow>>();
+                for (auto &&m : batch.matches)
+                {
+                    if (search->rows + rows->size() >= max_file_rows)
+                    {
+                        break;
+                    }
+                    FileRow row;
+                    row.cells.append(QString::number(batch.offset + m.groups[0].start));
+                    for (auto &&g : m.groups)
+                    {
+                        row.cells.append(QString::fromUtf8(g.text.data(), g.text.size()));
+                    }
+                    rows->push_back(std::move(row));
+                }
+                search->rows += rows->size();
+                search->matches += batch.matches.size();
+                postFileRows(search, rows, QString::fromWCharArray(L"已找到 %1 个匹配").arg(search->matches.load()));
+            }
+        }
+        catch (const std::exception &ex)
+        {
+            search->error = QString::fromUtf8(ex.what());
+        }
+    };
+    auto done = [this, search]()
+    {
+        endFileSearch(search, QString::fromWCharArray(L"共 %1 个匹配").arg(search->matches.load()));
+    };
+    runInBackground(work, done);
+}
+
+std::shared_ptr<FileSearch> MainWindow::beginFileSearch()
+{
+    stopFileSearch();
+    file_search = std::make_shared<FileSearch>();
+    stop_btn->setEnabled(true);
+    return file_search;
+}
+
+void MainWindow::stopFileSearch()
+{
+    if (file_search)
+    {
+        file_search->cancel = true;
+        file_search.reset();
+    }
+    stop_btn->setEnabled(false);
+}
+
+void MainWindow::postFileRows(std::shared_ptr<FileSearch> search, std::shared_ptr<std::vector<FileRow>> rows, QString message)
+{
+    // 可以在后台线程中调用。窗口析构时会先等待后台任务结束，this 在此期间一直有效
+    QMetaObject::invokeMethod(
+        this, [this, search, rows, message]()
+        {
+            // 搜索已被取代或停止，表格可能已经另作他用
+            if (search != file_search)
+            {
+                return;
+            }
+            TraceScope trace("fill table model");
+            for (auto &&row : *rows)
+            {
+                auto items = QList<QStandardItem *>();
+                for (auto &&cell : row.cells)
+                {
+                    auto item = new QStandardItem(cell);
+                    item->setToolTip(cell);
+                    items.append(item);
+                }
+                for (auto &&[column, tooltip] : row.marks)
+                {
+                    items[column]->setBackground(QBrush(QColor(Qt::red).lighter(170)));
+                    items[column]->setToolTip(tooltip);
+                }
+                table_model->appendRow(items);
+            }
+            statusbar->showMessage(message); },
+        Qt::QueuedConnection);
+}
+
+void MainWindow::endFileSearch(std::shared_ptr<FileSearch> search, QString message)
+{
+    if (search != file_search)
+    {
+        return;
+    }
+    auto cancelled = search->cancel.load();
+    file_search.reset();
+    stop_btn->setEnabled(false);
+    if (!search->error.isEmpty())
+    {
+        table_model->appendRow(new QStandardItem(QString::fromWCharArray(L"错误：%1").arg(search->error)));
+    }
+    if (cancelled)
+    {
+        message = QString::fromWCharArray(L"已停止，%1").arg(message);
+    }
+    if (search->rows >= max_file_rows)
+    {
+        message += QString::fromWCharArray(L"，只显示前 %1 行").arg(max_file_rows);
+    }
+    statusbar->showMessage(message);
+}
+
+void MainWindow::onSampleFile()
+{
+    // 强制刷新
+    onTimer();
+
+    auto filename = QFileDialog::getOpenFileName(this, QString::fromWCharArray(L"选择要抽样的文件"));
+    if (filename.isEmpty())
+    {
+        return;
+    }
+    QFile f(filename);
+    if (!f.open(QIODevice::ReadOnly))
+    {
+        QMessageBox::critical(this, QString::fromWCharArray(L"错误"), QString::fromWCharArray(L"打开文件失败"));
+        return;
+    }
+
+    combo->setCurrentIndex(0);
+    setTableModel(table_model);
+    table_model->clear();
+    result_edit->clear();
+    try
+    {
+        if (!re.has_value())
+        {
+            throw std::runtime_error(QString::fromWCharArray(L"无法解析").toUtf8().data());
+        }
+        // 32 个 256 KB 的窗口，共读取 8 MB，每个窗口最多显示 50 个匹配
+        auto result = regex_sample_fd(re.value(), f.handle(), 32, 256 << 10, 50);
+        TraceScope trace("fill table model");
+        auto group_names = regex_group_names(re.value());
+        table_model->setColumnCount(group_names.size() + 1);
+        table_model->setHeaderData(0, Qt::Orientation::Horizontal, QString::fromWCharArray(L"偏移"));
+        for (size_t i = 0; i < group_names.size(); i++)
+        {
+            if (group_names[i].length())
+            {
+                table_model->setHeaderData(i + 1, Qt::Orientation::Horizontal, QString("%1(%2)").arg(QString::fromUtf8(group_names[i].data(), group_names[i].size()), QString::number(i)));
+            }
+            else
+            {
+                table_model->setHeaderData(i + 1, Qt::Orientation::Horizontal, QString::number(i));
+            }
+        }
+        for (auto &&w : result.windows)
+        {
+            for (auto &&m : w.matches)
+            {
+                auto row = QList<QStandardItem *>();
+                row.append(new QStandardItem(QString::number(w.offset + m.groups[0].start)));
+                for (auto &&g : m.groups)
+                {
+                    auto text = QString::fromUtf8(g.text.data(), g.text.size());
+                    auto item = new QStandardItem(text);
+                    item->setToolTip(text);
+                    row.append(item);
+                }
+                table_model->appendRow(row);
+            }
+        }
+        if (result.exact)
+        {
+            statusbar->showMessage(QString::fromWCharArray(L"文件较小，已完整搜索，共 %1 个匹配").arg(static_cast<quint64>(result.estimate)));
+        }
+        else if (std::isinf(result.margin))
+        {
+            statusbar->showMessage(QString::fromWCharArray(L"抽样 %1 / %2 字节，估计共 %3 个匹配，窗口太少无法估算误差").arg(result.sampled).arg(result.file_len).arg(result.estimate, 0, 'f', 0));
+        }
+        else
+        {
+            statusbar->showMessage(QString::fromWCharArray(L"抽样 %1 / %2 字节，估计共 %3 ± %4 个匹配（95% 置信区间）").arg(result.sampled).arg(result.file_len).arg(result.estimate, 0, 'f', 0).arg(result.margin, 0, 'f', 0));
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        table_model->appendRow(new QStandardItem(QString::fromWCharArray(L"错误：%1").arg(QString::fromUtf8(ex.what()))));
+    }
+}
+
+std::vector<size_t> MainWindow::pickCsvColumns(const std::vector<std::string> &names)
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(QString::fromWCharArray(L"选择要搜索的列"));
+    auto list = new QListWidget();
+    list->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    for (auto &&name : names)
+    {
+        list->addItem(QString::fromUtf8(name.data(), name.size()));
+    }
+    if (list->count() > 0)
+    {
+        list->item(0)->setSelected(true);
+    }
+    auto buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    auto layout = new QVBoxLayout();
+    layout->addWidget(list);
+    layout->addWidget(buttons);
+    dialog.setLayout(layout);
+    std::vector<size_t> columns;
+    if (dialog.exec() == QDialog::Accepted)
+    {
+        for (int i = 0; i < list->count(); i++)
+        {
+            if (list->item(i)->isSelected())
+            {
+                columns.push_back(i);
+            }
+        }
+    }
+    return columns;
+}
+
+void MainWindow::onSearchCsv()
+{
+    // 强制刷新
+    onTimer();
+
+    auto filename = QFileDialog::getOpenFileName(this, QString::fromWCharArray(L"选择 CSV 文件"), "", "*.csv");
+    if (filename.isEmpty())
+    {
+        return;
+    }
+
+    combo->setCurrentIndex(0);
+    setTableModel(table_model);
+    table_model->clear();
+    result_edit->clear();
+    std::shared_ptr<CsvFile> csv_file;
+    std::shared_ptr<rust::Box<Regex>> regex;
+    std::vector<std::string> names;
+    std::vector<size_t> columns;
+    try
+    {
+        if (!re.has_value())
+        {
+            throw std::runtime_error(QString::fromWCharArray(L"无法解析").toUtf8().data());
+        }
+        csv_file = openCsv(filename);
+        names = csv_file->reader->get_col_names();
+        columns = pickCsvColumns(names);
+        if (columns.empty())
+        {
+            return;
+        }
+        // 后台线程使用正则的副本，之后修改正则不影响正在进行的搜索
+        regex = std::make_shared<rust::Box<Regex>>(regex_clone(re.value()));
+    }
+    catch (const std::exception &ex)
+    {
+        table_model->appendRow(new QStandardItem(QString::fromWCharArray(L"错误：%1").arg(QString::fromUtf8(ex.what()))));
+        return;
+    }
+    table_model->setColumnCount(names.size() + 1);
+    table_model->setHeaderData(0, Qt::Orientation::Horizontal, QString::fromWCharArray(L"行号"));
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        table_model->setHeaderData(i + 1, Qt::Orientation::Horizontal, QString::fromUtf8(names[i].data(), names[i].size()));
+    }
+
+    // 在后台线程中逐行读取，攒够一批后把选定列的字段首尾相接交给引擎，在线程池上并行搜索。
+    // 有匹配的行整理好后分批交给界面线程，超过上限后只计数
+    auto search = beginFileSearch();
+    auto scanned = std::make_shared<uint64_t>(0);
+    auto work = [this, csv_file, regex, names, columns, search, scanned]()
+    {
+        const size_t batch_rows = 16384;
+        const size_t batch_bytes = 16 << 20;
+        std::vector<csv::CSVRow> rows;
+        std::string text;
+        std::vector<uint32_t> ends;
+        uint64_t &row_count = *scanned;
+        auto field = [](const csv::CSVRow &row, size_t column)
+        {
+            return column < row.size() ? row[column].get_sv() : csv::string_view();
+        };
+        auto flush = [&]()
+        {
+            auto found = regex_match_fields(*regex, rust::Slice<const uint8_t>(reinterpret_cast<const uint8_t *>(text.data()), text.size()), rust::Slice<const uint32_t>(ends.data(), ends.size()));
+            auto first_row = row_count - rows.size();
+            auto table_rows = std::make_shared<std::vector<FileRow>>();
+            for (size_t i = 0; i < found.size();)
+            {
+                auto r = found[i].field / columns.size();
+                // 同一行中有匹配的列，位置为字段内的字节偏移
+                auto begin = i;
+                while (i < found.size() && found[i].field / columns.size() == r)
+                {
+                    i++;
+                }
+                search->matches++;
+                if (search->rows + table_rows->size() >= max_file_rows)
+                {
+                    continue;
+                }
+                auto &row = rows[r];
+                FileRow table_row;
+                table_row.cells.append(QString::number(first_row + r + 1));
+                for (size_t c = 0; c < names.size(); c++)
+                {
+                    auto sv = field(row, c);
+                    table_row.cells.append(QString::fromUtf8(sv.data(), sv.size()));
+                }
+                for (auto j = begin; j < i; j++)
+                {
+                    auto c = columns[found[j].field % columns.size()];
+                    auto sv = field(row, c);
+                    table_row.marks.emplace_back(c + 1, QString::fromWCharArray(L"匹配 (%1, %2)：%3").arg(found[j].start).arg(found[j].end).arg(QString::fromUtf8(sv.data() + found[j].start, found[j].end - found[j].start)));
+                }
+                table_rows->push_back(std::move(table_row));
+            }
+            search->rows += table_rows->size();
+            rows.clear();
+            text.clear();
+            ends.clear();
+            postFileRows(search, table_rows, QString::fromWCharArray(L"已搜索 %1 行，%2 行有匹配").arg(row_count).arg(search->matches.load()));
+        };
+        try
+        {
+            csv::CSVRow row;
+            while (!search->cancel && csv_file->reader->read_row(row))
+            {
+                for (auto c : columns)
+                {
+                    auto sv = field(row, c);
+                    text.append(sv.data(), sv.size());
+                    ends.push_back(static_cast<uint32_t>(text.size()));
+                }
+                rows.push_back(std::move(row));
+                row_count++;
+                if (rows.size() >= batch_rows || text.size() >= batch_bytes)
+                {
+                    flush();
+                }
+            }
+            if (!rows.empty())
+            {
+                flush();
+            }
+        }
+        catch (const std::exception &ex)
+        {
+            search->error = QString::fromUtf8(ex.what());
+        }
+    };
+    auto done = [this, search, scanned]()
+    {
+        endFileSearch(search, QString::fromWCharArray(L"共搜索 %1 行，%2 行有匹配").arg(*scanned).arg(search->matches.load()));
+    };
+    runInBackground(work, done);
+}
+
+void MainWindow::onSaveResults()
+{
+    // 强制刷新
+    onTimer();
+
+    if (!re.has_value())
+    {
+        QMessageBox::critical(this, QString::fromWCharArray(L"错误"), QString::fromWCharArray(L"无法解析"));
+        return;
+    }
+    auto filename = QFileDialog::getSaveFileName(this, QString::fromWCharArray(L"选择保存位置"), "", "*.rgxm");
+    if (filename.isEmpty())
+    {
+        return;
+    }
+    try
+    {
+        auto count = regex_save_results(re.value(), inputHaystack(), toStr(filename.toUtf8()), true);
+        statusbar->showMessage(QString::fromWCharArray(L"已保存 %1 个匹配").arg(count));
+    }
+    catch (const std::exception &ex)
+    {
+        QMessageBox::critical(this, QString::fromWCharArray(L"错误"), QString::fromUtf8(ex.what()));
+    }
+}
+
+void MainWindow::onOpenResults()
+{
+    auto filename = QFileDialog::getOpenFileName(this, QString::fromWCharArray(L"选择结果文件"), "", "*.rgxm");
+    if (filename.isEmpty())
+    {
+        return;
+    }
+    auto model = new ResultFileModel(this);
+    QString error;
+    if (!model->open(filename, error))
+    {
+        delete model;
+        QMessageBox::critical(this, QString::fromWCharArray(L"错误"), error);
+        return;
+    }
+    combo->setCurrentIndex(0);
+    setTableModel(model);
+    file_model = model;
+    statusbar->showMessage(QString::fromWCharArray(L"共 %1 个匹配").arg(model->matchCount()));
+}
+
+void MainWindow::setTableModel(QAbstractItemModel *model)
+{
+    if (result_table->model() == model)
+    {
+        return;
+    }
+    // 正在进行的文件搜索还会向 table_model 添加结果
+    stopFileSearch();
+    auto selection = result_table->selectionModel();
+    result_table->setModel(model);
+    delete selection;
+    connect(result_table->selectionModel(), &QItemSelectionModel::currentChanged, this, &MainWindow::onTableSelectionChanged);
+    // 切换走后释放映射
+    if (file_model != nullptr)
+    {
+        file_model->deleteLater();
+        file_model = nullptr;
+    }
+    if (store_model != nullptr)
+    {
+        store_model->deleteLater();
+        store_model = nullptr;
+    }
+}
+
+void MainWindow::onExecBtnClicked()
+{
+    // 强制刷新
+    onTimer();
+    stopFileSearch();
+
+    // 按 UTF-8 字节数计算输入大小，转换的结果会缓存下来供之后的搜索使用
+    if (combo->currentIndex() != 3)
+    {
+        qint64 input_size = 0;
+        try
+        {
+            input_size = haystack_len(inputHaystack());
+        }
+        catch (const std::exception &)
+        {
+            // 转换失败时由之后的搜索报告错误
+        }
+        if (!confirmCost(input_size))
+        {
+            return;
+        }
+    }
+
+    setTableModel(table_model);
+    table_model->clear();
+    replace_spans = rust::Vec<ReplaceSpan>();
+    replace_out.clear();
+    result_edit->clear();
+    minimap->clear();
+
+    {
+        TraceScope trace("run");
+        switch (combo->currentIndex())
+        {
+        case 0:
+            onMatch();
+            break;
+        case 1:
+            onReplace();
+            break;
+        case 2:
+            onSplit();
+            break;
+        case 3:
+            onDfaStats();
+            break;
+        default:
+            break;
+        }
+    }
+    // 每次执行后都写出，程序被强制结束时也不会丢失
+    try
+    {
+        trace_flush();
+    }
+    catch (const std::exception &ex)
+    {
+        statusbar->showMessage(QString::fromWCharArray(L"无法写入 trace：%1").arg(QString::fromUtf8(ex.what())));
+    }
+}
+
+void MainWindow::onCheckChanged()
+{
+    last_regex.clear();
+    onTextChanged();
+}
+
+QList<QStringList> MainWindow::getTableSelectedItems()
+{
+    QList<QStringList> result;
+    QStringList rowlist;
+    int lastrow = 0;
+    for (auto &&i : result_table->selectionModel()->selectedIndexes())
+    {
+        if (rowlist.empty())
+        {
+            lastrow = i.row();
+        }
+        if (i.row() != lastrow)
+        {
+            lastrow = i.row();
+            result.append(rowlist);
+            rowlist.clear();
+        }
+        rowlist.append(i.data().toString());
+    }
+    if (!rowlist.empty())
+    {
+        result.append(rowlist);
+    }
+    return result;
+}
+
+void MainWindow::onTableCopy()
+{
+    auto items = getTableSelectedItems();
+    QStringList result;
+    for (auto &&i : items)
+    {
+        result.append(i.join("\t"));
+    }
+    qApp->clipboard()->setText(result.join("\n"));
+}
+
+void MainWindow::onTableExportCsv()
+{
+    auto filename = QFileDialog::getSaveFileName(this, QString::fromWCharArray(L"选择导出文件"), "", "*.csv");
+    if (!filename.isEmpty())
+    {
+        QFile f(filename);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            QMessageBox::critical(this, QString::fromWCharArray(L"错误"), QString::fromWCharArray(L"打开文件失败"));
+            return;
+        }
+        auto model = result_table->model();
+        // 磁盘上的结果集可能超过视图能显示的 int 行，直接按 64 位行号读取
+        quint64 nRow = model->rowCount();
+        std::function<QString(quint64, int)> cell = [model](quint64 r, int c)
+        {
+            return model->data(model->index(r, c)).toString();
+        };
+        if (auto store = qobject_cast<MatchStoreModel *>(model))
+        {
+            nRow = store->matchCount();
+            cell = [store](quint64 r, int c)
+            {
+                return store->value(c, r);
+            };
+        }
+        else if (auto results = qobject_cast<ResultFileModel *>(model))
+        {
+            nRow = results->matchCount();
+            cell = [results](quint64 r, int c)
+            {
+                return results->value(c, r);
+            };
+        }
+        // 逐行写入缓冲区，攒够一块就写入文件，内存占用与结果的行数无关
+        std::stringstream ss;
+        auto writer = csv::make_csv_writer_buffered(ss);
+        auto drain = [&f, &ss](size_t threshold)
+        {
+            if (static_cast<size_t>(ss.tellp()) < threshold)
+            {
+                return true;
+            }
+            auto chunk = ss.str();
+            ss.str(std::string());
+            return f.write(chunk.data(), chunk.size()) == static_cast<qint64>(chunk.size());
+        };
+        // UTF-8 BOM
+        f.write("\xEF\xBB\xBF");
+        // 输出列标题
+        auto nCol = model->columnCount();
+        {
+            std::vector<std::string> row;
+            for (int i = 0; i < nCol; i++)
+            {
+                auto s = model->headerData(i, Qt::Orientation::Horizontal).toString().toUtf8();
+                row.emplace_back(s.data(), s.size());
+            }
+            writer << row;
+        }
+        // 输出全部内容
+        std::vector<std::string> row(nCol);
+        auto ok = true;
+        for (quint64 r = 0; ok && r < nRow; r++)
+        {
+            for (int c = 0; c < nCol; c++)
+            {
+                auto s = cell(r, c).toUtf8();
+                row[c].assign(s.data(), s.size());
+            }
+            writer << row;
+            ok = drain(1 << 20);
+        }
+        if (!ok || !drain(0))
+        {
+            QMessageBox::critical(this, QString::fromWCharArray(L"错误"), QString::fromWCharArray(L"写入文件失败"));
+            return;
+        }
+        statusbar->showMessage(QString::fromWCharArray(L"已导出 %1 行").arg(nRow));
+    }
+}
+
+void MainWindow::onMinimapClicked(double fraction)
+{
+    // 缩略条的每个桶对应相同数量的行，与滚动条一致，按比例换算成行号后跳到这一行的开头
+    auto doc = input_edit->document();
+    auto line = std::min(static_cast<int>(fraction * doc->blockCount()), doc->blockCount() - 1);
+    resetTextColor(input_edit);
+    auto cursor = input_edit->textCursor();
+    cursor.setPosition(doc->findBlockByNumber(line).position());
+    input_edit->setTextCursor(cursor);
+    input_edit->ensureCursorVisible();
+    input_edit->setFocus();
+}
+
+void MainWindow::onTableSelectionChanged(const QModelIndex &current, const QModelIndex &previous)
+{
+    auto data = current.data(Qt::UserRole + 1);
+    if (!data.isValid())
+    {
+        // 文件搜索的结果不对应输入框中的文本
+        statusbar->showMessage(current.data().toString());
+        return;
+    }
+    auto point = data.toPoint();
+    setTextColor(input_edit, point.x(), point.y());
+    statusbar->showMessage(QString("(%1, %2) %3").arg(point.x()).arg(point.y()).arg(current.data().toString()));
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == regex_edit || watched == input_edit)
+    {
+        if (event->type() == QEvent::FocusIn)
+        {
+            resetTextColor(static_cast<QPlainTextEdit *>(watched));
+        }
+    }
+    else if (watched == result_table)
+    {
+        if (event->type() == QEvent::ContextMenu)
+        {
             if (result_table->currentIndex().isValid())
             {
                 table_menu->exec(cursor().pos());
@@ -455,4 +1852,10 @@ bool MainWindow::eventFilter(QObject *watched, QEvent *event)
 
 MainWindow::~MainWindow()
 {
+    if (file_search)
+    {
+        file_search->cancel = true;
+    }
+    // 后台任务可能还在调用引擎，等它们结束后再释放成员
+    background.waitForDone();
 }
@@ -2,6 +2,26 @@
 #define MAINWINDOW_H
 
 #include "cppbridge.rs.h"
+#include "matchstore.h"
+#include "minimap.h"
+#include "resultfile.h"
+#include "trace.h"
+
+// 后台文件搜索的状态，由搜索线程和界面线程共享
+struct FileSearch
+{
+    std::atomic<bool> cancel = false;
+    std::atomic<uint64_t> matches = 0;
+    std::atomic<size_t> rows = 0; // 已交给界面显示的行数
+    QString error;                // 搜索线程结束前写入，结束后在界面线程读取
+};
+
+// 后台线程中整理好的一行结果，界面线程只负责添加到表格
+struct FileRow
+{
+    QStringList cells;
+    std::vector<std::pair<int, QString>> marks; // 需要高亮的单元格及其提示
+};
 
 class MainWindow : public QMainWindow
 {
@@ -15,7 +35,12 @@ private:
     bool eventFilter(QObject *watched, QEvent *event);
     void resetTextColor(QPlainTextEdit *edit);
     void setTextColor(QPlainTextEdit *edit, int start, int len);
-    void fillTree(QStandardItem *parent, const TreeNode *tree);
+    void fillTree(const ParseTree &tree);
+    void fillProfile();
+    RegexOptions regexOptions();
+    const rust::Box<ReplaceTemplate> &replaceTemplate();
+    const rust::Box<Haystack> &inputHaystack();
+    bool confirmCost(qint64 input_size);
     void onTextChanged();
     void onTreeCurrentChanged(const QModelIndex &current, const QModelIndex &);
     void onExecBtnClicked();
@@ -26,23 +51,77 @@ private:
     void onTimer();
     void onComboChanged(int);
     void onMatch();
+    void onMatchToDisk();
+    void showMatchStore(rust::Box<MatchStore> store);
     void onReplace();
     void onSplit();
+    void onStreamFile();
+    std::shared_ptr<FileSearch> beginFileSearch();
+    void stopFileSearch();
+    void postFileRows(std::shared_ptr<FileSearch> search, std::shared_ptr<std::vector<FileRow>> rows, QString message);
+    void endFileSearch(std::shared_ptr<FileSearch> search, QString message);
+    void onSampleFile();
+    std::vector<size_t> pickCsvColumns(const std::vector<std::string> &names);
+    void onSearchCsv();
+    void onSaveResults();
+    void onOpenResults();
+    void setTableModel(QAbstractItemModel *model);
+    void onDfaStats();
+    void onUnicodeAdvice();
+    void showUnicodeAdvice(const UnicodeAdvice &advice);
+    void onLoadLibrary();
+    void loadLibrary(const QString &filename);
+    void showLibrary(double load_ms);
+    void onLibraryPicked(int index);
+    void runInBackground(std::function<void()> work, std::function<void()> done);
+    void onMinimapClicked(double fraction);
+    void highlightReplaced();
+    void onResultCursorChanged();
     void onTableSelectionChanged(const QModelIndex &current, const QModelIndex &previous);
 
     QTreeView *treeview;
     QPlainTextEdit *regex_edit;
     QPlainTextEdit *input_edit;
+    Minimap *minimap;
     QStandardItemModel *tree_model;
     QStandardItemModel *table_model;
+    ResultFileModel *file_model = nullptr;
+    MatchStoreModel *store_model = nullptr;
     QTableView *result_table;
     QString last_regex;
     std::optional<rust::Box<Regex>> re;
+    QString last_rep;
+    std::optional<rust::Box<ReplaceTemplate>> rep_template;
+    // 输入框文本的 UTF-8 副本，文本变化时清空，多次搜索共用
+    std::optional<rust::Box<Haystack>> haystack;
+    rust::Vec<ReplaceSpan> replace_spans;
+    // 替换段在 result_edit 中的 UTF-16 位置，与 replace_spans 一一对应
+    std::vector<std::pair<int, int>> replace_out;
     QStatusBar *statusbar;
     QCheckBox *ignore_whitespace_check;
     QCheckBox *case_insensitive_check;
     QCheckBox *multi_line_check;
     QCheckBox *dot_matches_new_line_check;
+    QCheckBox *unicode_check;
+    QCheckBox *crlf_check;
+    QComboBox *line_terminator_combo;
+    QCheckBox *swap_greed_check;
+    QSpinBox *nest_limit_spin;
+    QPushButton *unicode_btn;
+    QPushButton *library_btn;
+    QComboBox *library_combo;
+    std::optional<rust::Box<PatternLibrary>> library;
+    // 后台任务使用的线程池，窗口析构时等待其中的任务结束
+    QThreadPool background;
+    std::shared_ptr<FileSearch> file_search;
+    QPushButton *stop_btn;
+    QCheckBox *profile_check;
+    QSpinBox *dfa_size_spin;
+    QSpinBox *threads_spin;
+    QSpinBox *budget_spin;
+    QCheckBox *disk_check;
+    QTableView *profile_view;
+    QStandardItemModel *profile_model;
     QMenu *table_menu;
     QTimer *timer;
     QComboBox *combo;
@@ -0,0 +1,126 @@
+#include "pch.h"
+#include "matchstore.h"
+
+static const quint64 no_offset = UINT64_MAX;
+
+MatchStoreModel::MatchStoreModel(rust::Box<MatchStore> store, QObject *parent) : QAbstractTableModel(parent), store(std::move(store))
+{
+}
+
+bool MatchStoreModel::open(QString &error)
+{
+    auto &layout = store_layout(store);
+    if (layout.rows == 0)
+    {
+        return true;
+    }
+    file.setFileName(QString::fromUtf8(layout.path.data(), layout.path.size()));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = QString::fromWCharArray(L"打开临时文件失败");
+        return false;
+    }
+    quint64 size = file.size();
+    base = file.map(0, size);
+    if (base == nullptr)
+    {
+        error = QString::fromWCharArray(L"映射临时文件失败");
+        return false;
+    }
+    // 先检查每页都在文件范围内，之后读取时只需检查值的范围
+    auto record_size = layout.group_names.size() * 16;
+    if (layout.page_bytes == 0)
+    {
+        error = QString::fromWCharArray(L"临时文件不完整");
+        return false;
+    }
+    for (auto &&page : layout.pages)
+    {
+        if (page.rows * record_size > layout.page_bytes || page.index >= size / layout.page_bytes ||
+            page.index * layout.page_bytes + page.rows * record_size > size)
+        {
+            error = QString::fromWCharArray(L"临时文件不完整");
+            return false;
+        }
+    }
+    return true;
+}
+
+quint64 MatchStoreModel::matchCount() const
+{
+    return store_layout(store).rows;
+}
+
+int MatchStoreModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() || base == nullptr)
+    {
+        return 0;
+    }
+    // 视图的行号是 int，超出的部分无法显示
+    return static_cast<int>(std::min<quint64>(matchCount(), INT_MAX));
+}
+
+int MatchStoreModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : store_layout(store).group_names.size();
+}
+
+const uchar *MatchStoreModel::record(quint64 row) const
+{
+    auto &layout = store_layout(store);
+    // 找到 first_row 不大于 row 的最后一页
+    auto page = std::upper_bound(layout.pages.begin(), layout.pages.end(), row, [](quint64 row, const StorePage &page)
+                                 { return row < page.first_row; });
+    --page;
+    return base + page->index * layout.page_bytes + (row - page->first_row) * layout.group_names.size() * 16;
+}
+
+QString MatchStoreModel::value(int group, quint64 row) const
+{
+    auto p = record(row) + group * 16;
+    auto start = qFromLittleEndian<quint64>(p);
+    auto end = qFromLittleEndian<quint64>(p + 8);
+    auto text = store_text(store);
+    // 未参与匹配的分组
+    if (start == no_offset || end < start || end > text.size())
+    {
+        return QString();
+    }
+    return QString::fromUtf8(text.data() + start, end - start);
+}
+
+QVariant MatchStoreModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::ToolTipRole && role != Qt::UserRole + 1))
+    {
+        return QVariant();
+    }
+    if (role != Qt::UserRole + 1)
+    {
+        return value(index.column(), index.row());
+    }
+    auto p = record(index.row()) + index.column() * 16;
+    auto start = qFromLittleEndian<quint64>(p);
+    auto end = qFromLittleEndian<quint64>(p + 8);
+    // 未参与匹配的分组
+    if (start == no_offset || end < start || end > store_text(store).size())
+    {
+        return QPoint(0, 0);
+    }
+    return QPoint(start, end);
+}
+
+QVariant MatchStoreModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal)
+    {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    auto &name = store_layout(store).group_names[section];
+    if (name.empty())
+    {
+        return QString::number(section);
+    }
+    return QString("%1(%2)").arg(QString::fromUtf8(name.data(), name.size()), QString::number(section));
+}
@@ -0,0 +1,35 @@
+#ifndef MATCHSTORE_H
+#define MATCHSTORE_H
+
+#include "cppbridge.rs.h"
+
+// 只读映射 regex_engine 写到临时文件的全部匹配（格式见 matchstore.rs），
+// 表格需要显示哪一行才读取哪一行，分组的值从 MatchStore 保存的输入中截取
+class MatchStoreModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    MatchStoreModel(rust::Box<MatchStore> store, QObject *parent = nullptr);
+
+    // 失败时返回 false，error 中为原因
+    bool open(QString &error);
+    quint64 matchCount() const;
+    // 不受 rowCount 的 int 范围限制，导出时用来读取全部匹配
+    QString value(int group, quint64 row) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    // 第 row 行记录的起始位置
+    const uchar *record(quint64 row) const;
+
+    // 必须在 file 之前声明：先取消映射，再由 MatchStore 删除文件
+    rust::Box<MatchStore> store;
+    QFile file;
+    const uchar *base = nullptr;
+};
+#endif // MATCHSTORE_H
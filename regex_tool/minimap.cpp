@@ -0,0 +1,59 @@
+#include "pch.h"
+#include "minimap.h"
+
+Minimap::Minimap(QWidget *parent) : QWidget(parent)
+{
+    setFixedWidth(14);
+    setCursor(Qt::PointingHandCursor);
+    setToolTip(QString::fromWCharArray(L"匹配分布，点击跳转"));
+}
+
+int Minimap::bucketCount() const
+{
+    // 每个像素行一个桶
+    return std::clamp(height(), 16, 4096);
+}
+
+void Minimap::setDensity(const std::vector<uint32_t> &density)
+{
+    this->density = density;
+    max_count = density.empty() ? 0 : *std::max_element(density.begin(), density.end());
+    update();
+}
+
+void Minimap::clear()
+{
+    density.clear();
+    max_count = 0;
+    update();
+}
+
+void Minimap::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().base());
+    if (density.empty() || max_count == 0)
+    {
+        return;
+    }
+    auto color = QColor(Qt::red);
+    auto h = static_cast<double>(height()) / density.size();
+    for (size_t i = 0; i < density.size(); i++)
+    {
+        if (density[i] == 0)
+        {
+            continue;
+        }
+        // 有匹配的桶至少保留一定的深度，避免稀疏的匹配看不见
+        color.setAlphaF(0.25 + 0.75 * density[i] / max_count);
+        painter.fillRect(QRectF(0, i * h, width(), std::max(h, 1.0)), color);
+    }
+}
+
+void Minimap::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton && height() > 0)
+    {
+        emit clicked(std::clamp(event->pos().y() / static_cast<double>(height()), 0.0, 1.0));
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef MINIMAP_H
+#define MINIMAP_H
+
+// 显示匹配密度的缩略条，每个桶对应输入文本中相同数量的行
+class Minimap : public QWidget
+{
+    Q_OBJECT
+
+public:
+    Minimap(QWidget *parent = nullptr);
+
+    int bucketCount() const;
+    void setDensity(const std::vector<uint32_t> &density);
+    void clear();
+
+signals:
+    // 点击位置在整个输入中的比例，0 ~ 1
+    void clicked(double fraction);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+
+private:
+    std::vector<uint32_t> density;
+    uint32_t max_count = 0;
+};
+#endif // MINIMAP_H
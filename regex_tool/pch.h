@@ -1,33 +1,56 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 #include <optional>
 
+#include <QAbstractTableModel>
 #include <QApplication>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QDialog>
+#include <QDialogButtonBox>
 #include <QDebug>
 #include <QFile>
 #include <QFileDialog>
+#include <QFutureWatcher>
 #include <QVBoxLayout>
 #include <QGroupBox>
+#include <QHeaderView>
 #include <QLabel>
+#include <QListWidget>
 #include <QMainWindow>
 #include <QMenu>
 #include <QMessageBox>
+#include <QMouseEvent>
+#include <QPainter>
 #include <QPushButton>
 #include <QStatusBar>
 #include <QTableView>
 #include <QPlainTextEdit>
+#include <QTextDocument>
+#include <QThreadPool>
 #include <QToolBar>
+#include <QtEndian>
 #include <QTreeView>
 #include <QTimer>
+#include <QtConcurrent>
 #include <QStandardItemModel>
 #include <QClipboard>
 #include <QSplitter>
+#include <QSpinBox>
 
 #include "csv.hpp"
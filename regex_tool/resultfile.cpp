@@ -0,0 +1,151 @@
+#include "pch.h"
+#include "resultfile.h"
+
+static const quint64 header_len = 64;
+static const quint64 no_offset = UINT64_MAX;
+
+ResultFileModel::ResultFileModel(QObject *parent) : QAbstractTableModel(parent)
+{
+}
+
+quint64 ResultFileModel::u64(quint64 offset) const
+{
+    return qFromLittleEndian<quint64>(base + offset);
+}
+
+quint32 ResultFileModel::u32(quint64 offset) const
+{
+    return qFromLittleEndian<quint32>(base + offset);
+}
+
+bool ResultFileModel::open(const QString &filename, QString &error)
+{
+    file.setFileName(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = QString::fromWCharArray(L"打开文件失败");
+        return false;
+    }
+    size = file.size();
+    base = size >= header_len ? file.map(0, size) : nullptr;
+    if (base == nullptr || memcmp(base, "RGXMATCH", 8) != 0)
+    {
+        error = QString::fromWCharArray(L"不是有效的结果文件");
+        return false;
+    }
+    if (u32(8) != 2)
+    {
+        error = QString::fromWCharArray(L"不支持的结果文件版本 %1").arg(u32(8));
+        return false;
+    }
+    auto group_count = u32(12);
+    match_count = u64(16);
+    has_values = (u32(24) & 1) != 0;
+    auto names_offset = u64(32);
+    records_offset = u64(40);
+    heap_offset = u64(48);
+    heap_len = u64(56);
+
+    // 先检查各段都在文件范围内，之后读取时只需检查值的长度
+    auto invalid = [&error]()
+    {
+        error = QString::fromWCharArray(L"结果文件已损坏");
+        return false;
+    };
+    entry_size = has_values ? 24 : 16;
+    if (group_count == 0 || group_count > size / entry_size || records_offset > size)
+    {
+        return invalid();
+    }
+    record_size = group_count * entry_size;
+    if (match_count > (size - records_offset) / record_size)
+    {
+        return invalid();
+    }
+    if (has_values && (heap_offset > size || heap_len > size - heap_offset))
+    {
+        return invalid();
+    }
+    auto pos = names_offset;
+    for (quint32 i = 0; i < group_count; i++)
+    {
+        if (pos > records_offset || records_offset - pos < 4 || records_offset - pos - 4 < u32(pos))
+        {
+            return invalid();
+        }
+        auto len = u32(pos);
+        group_names.append(QString::fromUtf8(reinterpret_cast<const char *>(base + pos + 4), len));
+        pos += 4 + len;
+    }
+    return true;
+}
+
+quint64 ResultFileModel::matchCount() const
+{
+    return match_count;
+}
+
+int ResultFileModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+    {
+        return 0;
+    }
+    // 视图的行号是 int，超出的部分无法显示
+    return static_cast<int>(std::min<quint64>(match_count, INT_MAX));
+}
+
+int ResultFileModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : group_names.size();
+}
+
+QString ResultFileModel::value(int group, quint64 row) const
+{
+    auto entry = records_offset + row * record_size + group * entry_size;
+    auto start = u64(entry);
+    auto end = u64(entry + 8);
+    if (start == no_offset)
+    {
+        return QString();
+    }
+    if (!has_values)
+    {
+        return QString("(%1, %2)").arg(start).arg(end);
+    }
+    auto offset = u64(entry + 16);
+    if (end < start || offset > heap_len || end - start > heap_len - offset)
+    {
+        return QString();
+    }
+    return QString::fromUtf8(reinterpret_cast<const char *>(base + heap_offset + offset), end - start);
+}
+
+QVariant ResultFileModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+    {
+        return QVariant();
+    }
+    switch (role)
+    {
+    case Qt::DisplayRole:
+    case Qt::ToolTipRole:
+        return value(index.column(), index.row());
+    default:
+        return QVariant();
+    }
+}
+
+QVariant ResultFileModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal)
+    {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    if (group_names[section].isEmpty())
+    {
+        return QString::number(section);
+    }
+    return QString("%1(%2)").arg(group_names[section], QString::number(section));
+}
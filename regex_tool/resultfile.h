@@ -0,0 +1,40 @@
+#ifndef RESULTFILE_H
+#define RESULTFILE_H
+
+// 只读映射 regex_engine 写出的二进制结果文件（格式见 resultfile.rs），
+// 打开时只校验文件头，表格需要显示哪一行才读取哪一行
+class ResultFileModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    ResultFileModel(QObject *parent = nullptr);
+
+    // 失败时返回 false，error 中为原因
+    bool open(const QString &filename, QString &error);
+    quint64 matchCount() const;
+    // 不受 rowCount 的 int 范围限制，导出时用来读取全部匹配
+    QString value(int group, quint64 row) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    quint64 u64(quint64 offset) const;
+    quint32 u32(quint64 offset) const;
+
+    QFile file;
+    const uchar *base = nullptr;
+    quint64 size = 0;
+    quint64 match_count = 0;
+    bool has_values = false;
+    quint64 records_offset = 0;
+    quint64 entry_size = 0;
+    quint64 record_size = 0;
+    quint64 heap_offset = 0;
+    quint64 heap_len = 0;
+    QStringList group_names;
+};
+#endif // RESULTFILE_H
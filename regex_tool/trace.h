@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "cppbridge.rs.h"
+
+// 作用域计时器，与引擎一侧的计时一起写入 REGEX_TOOL_TRACE 指定的 Chrome trace 文件。
+// 未开启时只检查一次开关。name 必须是在作用域结束前一直有效的 ASCII 字符串
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name)
+        : name(name), enabled(trace_enabled()), start(enabled ? trace_now() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (enabled)
+        {
+            trace_record(name, start);
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name;
+    bool enabled;
+    uint64_t start;
+};
+
+#endif // TRACE_H